@@ -0,0 +1,291 @@
+#ifndef ASSET_PACKAGE_H
+#define ASSET_PACKAGE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <iostream>
+
+// a file inside the mapped package, valid as long as the package stays open
+struct AssetBlob {
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+};
+
+// Read-only archive of the runtime assets, built by tools/asset_packer.cpp and mapped into memory as a whole
+// (main.cpp --package FILE). The mesh cache, the texture loader and Shader look files up here first and fall
+// back to the loose files, so the pointers they get are straight into the mapping: DDS mip levels go to
+// glCompressedTexImage2D and cached meshes are parsed without a file read.
+//
+// Files are found by their path relative to the project root, with "." and ".." resolved, so every spelling
+// of a path the renderer uses (FileSystem::getPath, model relative texture paths) leads to the same entry.
+//
+// layout (all integers little endian):
+//   Header, the files, each starting at a multiple of ALIGNMENT, then the index at Header::indexOffset:
+//   per file u64 offset, u64 size, u32 name length and the name, padded to 8 bytes
+class AssetPackage
+{
+public:
+    static const uint32_t MAGIC   = 0x4B415053; // "SPAK"
+    static const uint32_t VERSION = 1;
+    // enough for any vertex, index or block compressed texture data and a cache line
+    static const size_t ALIGNMENT = 64;
+
+    static AssetPackage& instance()
+    {
+        static AssetPackage package;
+        return package;
+    }
+
+    // maps the package, paths under root are looked up relative to it. Replaces a package opened before.
+    bool open(const std::string &path, const std::string &root = "")
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            std::cout << "ASSET_PACKAGE:: cannot open " << path << std::endl;
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(Header))
+        {
+            ::close(fd);
+            return false;
+        }
+        mappedSize = (size_t)info.st_size;
+        void *data = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            return false;
+        mapping = (const unsigned char*)data;
+        this->root = normalize(root);
+        if (!readIndex())
+        {
+            std::cout << "ASSET_PACKAGE:: " << path << " is not a valid package" << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (mapping)
+            munmap((void*)mapping, mappedSize);
+        mapping = nullptr;
+        mappedSize = 0;
+        files.clear();
+    }
+
+    bool isOpen() const
+    {
+        return mapping != nullptr;
+    }
+
+    size_t fileCount() const
+    {
+        return files.size();
+    }
+
+    // safe to call from any thread while the package stays open
+    bool find(const std::string &path, AssetBlob &blob) const
+    {
+        if (files.empty())
+            return false;
+        std::unordered_map<std::string, AssetBlob>::const_iterator file = files.find(key(path));
+        if (file == files.end())
+            return false;
+        blob = file->second;
+        return true;
+    }
+
+    // the name path is stored under
+    std::string key(const std::string &path) const
+    {
+        return relative(path, root);
+    }
+
+    // path normalized and made relative to the normalized directory root, paths outside root stay as they are
+    static std::string relative(const std::string &path, const std::string &root)
+    {
+        std::string normalized = normalize(path);
+        if (!root.empty() && normalized.compare(0, root.size(), root) == 0
+            && (normalized.size() == root.size() || normalized[root.size()] == '/'))
+            normalized.erase(0, std::min(root.size() + 1, normalized.size()));
+        return normalized;
+    }
+
+    // resolves "." and ".." and turns backslashes into slashes, a leading slash is kept
+    static std::string normalize(const std::string &path)
+    {
+        std::vector<std::string> parts;
+        size_t start = 0;
+        std::string unified = path;
+        for (char &c : unified)
+            if (c == '\\')
+                c = '/';
+        while (start <= unified.size())
+        {
+            size_t slash = unified.find('/', start);
+            if (slash == std::string::npos)
+                slash = unified.size();
+            std::string part = unified.substr(start, slash - start);
+            if (part == "..")
+            {
+                if (!parts.empty() && parts.back() != "..")
+                    parts.pop_back();
+                else
+                    parts.push_back(part);
+            }
+            else if (!part.empty() && part != ".")
+                parts.push_back(part);
+            start = slash + 1;
+        }
+        std::string result = !unified.empty() && unified[0] == '/' ? "/" : "";
+        for (size_t i = 0; i < parts.size(); i++)
+            result += (i ? "/" : "") + parts[i];
+        return result;
+    }
+
+    // streams files into a new package, used by the packer
+    class Writer
+    {
+    public:
+        bool begin(const std::string &path)
+        {
+            this->path = path;
+            temporaryPath = path + ".tmp";
+            file = fopen(temporaryPath.c_str(), "wb");
+            if (!file)
+                return false;
+            Header header = {};
+            offset = 0;
+            return write(&header, sizeof(header));
+        }
+
+        bool add(const std::string &name, const void *data, size_t size)
+        {
+            if (!file || !pad(ALIGNMENT))
+                return false;
+            index.push_back(Entry{normalize(name), offset, size});
+            return write(data, size);
+        }
+
+        // writes the index and moves the package into place
+        bool finish()
+        {
+            if (!file)
+                return false;
+            bool written = pad(8);
+            Header header = {MAGIC, VERSION, (uint32_t)index.size(), 0, offset};
+            for (const Entry &entry : index)
+            {
+                uint32_t length = (uint32_t)entry.name.size();
+                written = written && write(&entry.offset, sizeof(entry.offset)) && write(&entry.size, sizeof(entry.size))
+                          && write(&length, sizeof(length)) && write(entry.name.data(), length) && pad(8);
+            }
+            written = written && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+            written = fclose(file) == 0 && written;
+            file = nullptr;
+            if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0)
+            {
+                remove(temporaryPath.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        // bytes written so far
+        uint64_t size() const
+        {
+            return offset;
+        }
+
+    private:
+        struct Entry {
+            std::string name;
+            uint64_t offset, size;
+        };
+
+        std::string path, temporaryPath;
+        FILE *file = nullptr;
+        uint64_t offset = 0;
+        std::vector<Entry> index;
+
+        bool write(const void *data, size_t size)
+        {
+            if (size > 0 && fwrite(data, 1, size, file) != size)
+                return false;
+            offset += size;
+            return true;
+        }
+
+        bool pad(size_t alignment)
+        {
+            static const unsigned char zeros[ALIGNMENT] = {};
+            size_t padding = (size_t)((alignment - offset % alignment) % alignment);
+            return write(zeros, padding);
+        }
+    };
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t fileCount;
+        uint32_t reserved;
+        uint64_t indexOffset;
+    };
+
+    const unsigned char *mapping = nullptr;
+    size_t mappedSize = 0;
+    std::string root;
+    std::unordered_map<std::string, AssetBlob> files;
+
+    AssetPackage() {}
+
+    ~AssetPackage()
+    {
+        close();
+    }
+
+    bool readIndex()
+    {
+        Header header;
+        memcpy(&header, mapping, sizeof(header));
+        if (header.magic != MAGIC || header.version != VERSION || header.indexOffset > mappedSize)
+            return false;
+        size_t offset = (size_t)header.indexOffset;
+        for (uint32_t i = 0; i < header.fileCount; i++)
+        {
+            uint64_t fileOffset, fileSize;
+            uint32_t length;
+            if (mappedSize - offset < sizeof(fileOffset) + sizeof(fileSize) + sizeof(length))
+                return false;
+            memcpy(&fileOffset, mapping + offset, sizeof(fileOffset));
+            memcpy(&fileSize, mapping + offset + 8, sizeof(fileSize));
+            memcpy(&length, mapping + offset + 16, sizeof(length));
+            offset += 20;
+            if (mappedSize - offset < length || fileOffset > mappedSize || fileSize > mappedSize - fileOffset)
+                return false;
+            AssetBlob blob;
+            blob.data = mapping + fileOffset;
+            blob.size = (size_t)fileSize;
+            files[std::string((const char*)mapping + offset, length)] = blob;
+            offset = std::min((offset + length + 7) & ~(size_t)7, mappedSize);
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/camera.h>
+#include <learnopengl/profiler.h>
+#include <learnopengl/render_stats.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Scripted, timed run of the render loop (main.cpp --bench N). The scene is drawn into an offscreen framebuffer
+// of a hidden window whose context is preferably created through EGL or OSMesa, so it also runs on CI machines
+// without a GPU (Mesa llvmpipe). The camera flies a fixed loop, the scene clock advances 1/60 s per frame and
+// every frame ends with glFinish, so the measured frame time includes the GPU work.
+//
+//   bench.recordStartup("shaders", ms);  // before the first frame, any number of startup steps
+//   bench.endFrame(profiler);   // glFinish, records frame time, the profiler's stage times and RenderStats
+//   bench.end();                // after the last frame, before the context goes away
+class Benchmark
+{
+public:
+    Benchmark(unsigned int frames, unsigned int width, unsigned int height)
+        : frames(frames), width(width), height(height) {}
+
+    ~Benchmark()
+    {
+        end();
+    }
+
+    bool enabled() const
+    {
+        return frames > 0;
+    }
+
+    // must be called before glfwInit. Without a display server the window can only come from GLFW's
+    // null platform (GLFW 3.4 and newer), which in turn only supports OSMesa contexts.
+    void initHints() const
+    {
+#ifdef GLFW_PLATFORM_NULL
+        if (enabled() && !getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY"))
+            glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    }
+
+    // hidden window, trying EGL, OSMesa and the native context API in that order. Expects the context
+    // version hints to be set already.
+    GLFWwindow* createWindow(const char *title) const
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        const int contextApis[] = {GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API, GLFW_NATIVE_CONTEXT_API};
+        for (int api : contextApis)
+        {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, api);
+            GLFWwindow *window = glfwCreateWindow((int)width, (int)height, title, NULL, NULL);
+            if (window)
+                return window;
+        }
+        return NULL;
+    }
+
+    // creates and binds the offscreen framebuffer, the warm up frames start here. Call it once everything
+    // is loaded, so that no upload lands in the measured frames.
+    void begin()
+    {
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, (GLsizei)width, (GLsizei)height);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, (GLsizei)width, (GLsizei)height);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "BENCHMARK:: offscreen framebuffer is not complete" << std::endl;
+        glViewport(0, 0, (GLsizei)width, (GLsizei)height);
+        frame = 0;
+        frameStart = Clock::now();
+    }
+
+    // deletes the offscreen framebuffer once the run is over, must be called while the context is still current
+    void end()
+    {
+        if (!framebuffer)
+            return;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+        framebuffer = 0;
+    }
+
+    // time a step before the render loop took, reported under startup_ms
+    void recordStartup(const std::string &name, double ms)
+    {
+        startup.push_back(std::make_pair(name, ms));
+    }
+
+    bool running() const
+    {
+        return frame < WARMUP_FRAMES + frames;
+    }
+
+    // deterministic scene clock
+    float sceneTime() const
+    {
+        return (float)frame / 60.0f;
+    }
+
+    // places the camera on the flight path for the current frame
+    void applyCamera(Camera &camera) const
+    {
+        static const Keyframe path[] = {
+            {glm::vec3(0.0f, 0.0f, 30.0f), -90.0f, 0.0f},
+            {glm::vec3(40.0f, 10.0f, -60.0f), -110.0f, -5.0f},
+            {glm::vec3(-60.0f, 20.0f, -250.0f), -60.0f, 0.0f},
+            {glm::vec3(-20.0f, -10.0f, 60.0f), 90.0f, -10.0f},
+            {glm::vec3(0.0f, -10.0f, 180.0f), 270.0f, 0.0f},
+        };
+        const unsigned int count = sizeof(path) / sizeof(path[0]);
+        unsigned int measured = frame < WARMUP_FRAMES ? 0 : frame - WARMUP_FRAMES;
+        float position = (float)measured / (float)std::max(frames, 1u) * count;
+        unsigned int segment = std::min((unsigned int)position, count - 1);
+        float t = position - (float)segment;
+
+        // Catmull-Rom through the (closed) loop of positions, the angles are interpolated linearly
+        const Keyframe &p0 = path[(segment + count - 1) % count], &p1 = path[segment];
+        const Keyframe &p2 = path[(segment + 1) % count], &p3 = path[(segment + 2) % count];
+        float t2 = t * t, t3 = t2 * t;
+        camera.Position = 0.5f * ((2.0f * p1.position) + (p2.position - p0.position) * t
+                                  + (2.0f * p0.position - 5.0f * p1.position + 4.0f * p2.position - p3.position) * t2
+                                  + (3.0f * p1.position - p0.position - 3.0f * p2.position + p3.position) * t3);
+        float nextYaw = segment + 1 == count ? p2.yaw + 360.0f : p2.yaw;
+        camera.Yaw = p1.yaw + (nextYaw - p1.yaw) * t;
+        camera.Pitch = p1.pitch + (p2.pitch - p1.pitch) * t;
+        // recomputes the camera vectors without moving it
+        camera.ProcessMouseMovement(0.0f, 0.0f);
+    }
+
+    // the stage times are those of the frame the profiler resolved last, a few frames behind but the
+    // same number of frames is summed
+    void endFrame(const Profiler &profiler)
+    {
+        if (!enabled())
+            return;
+        Clock::time_point finishStart = Clock::now();
+        glFinish();
+        Clock::time_point now = Clock::now();
+        if (frame >= WARMUP_FRAMES)
+        {
+            frameTimes.push_back(std::chrono::duration<double, std::milli>(now - frameStart).count());
+            drawCalls.push_back(RenderStats::frame().drawCalls);
+            triangles.push_back(RenderStats::frame().triangles);
+            stateChanges.push_back(RenderStats::frame().stateChanges);
+            skippedStateChanges.push_back(RenderStats::frame().skippedStateChanges);
+            findStage("gpu wait").cpuMs += std::chrono::duration<double, std::milli>(now - finishStart).count();
+            for (const Profiler::Timing &timing : profiler.lastFrame())
+            {
+                Stage &stage = findStage(profiler.stageName(timing.stage));
+                stage.cpuMs += timing.cpuMs;
+                if (timing.gpuMs >= 0.0)
+                {
+                    stage.gpuMs += timing.gpuMs;
+                    stage.gpuFrames++;
+                }
+            }
+        }
+        frame++;
+        frameStart = now;
+    }
+
+    // frame time percentiles, mean CPU and GPU time per stage, the draw and state change counters as JSON
+    std::string report() const
+    {
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(3);
+        json << "{\n";
+        json << "  \"frames\": " << frameTimes.size() << ",\n";
+        json << "  \"resolution\": [" << width << ", " << height << "],\n";
+        json << "  \"renderer\": \"" << glString(GL_RENDERER) << "\",\n";
+        json << "  \"version\": \"" << glString(GL_VERSION) << "\",\n";
+        json << "  \"startup_ms\": {";
+        for (size_t i = 0; i < startup.size(); i++)
+            json << (i ? ", " : "") << "\"" << startup[i].first << "\": " << startup[i].second;
+        json << "},\n";
+
+        std::vector<double> sorted = frameTimes;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double ms : sorted)
+            total += ms;
+        size_t n = std::max(sorted.size(), (size_t)1);
+        json << "  \"frame_ms\": {\"mean\": " << total / n << ", \"min\": " << percentile(sorted, 0.0)
+             << ", \"p50\": " << percentile(sorted, 0.50) << ", \"p95\": " << percentile(sorted, 0.95)
+             << ", \"p99\": " << percentile(sorted, 0.99) << ", \"max\": " << percentile(sorted, 1.0) << "},\n";
+
+        json << "  \"cpu_stage_ms\": {";
+        for (size_t i = 0; i < stages.size(); i++)
+            json << (i ? ", " : "") << "\"" << stages[i].name << "\": " << stages[i].cpuMs / n;
+        json << "},\n";
+        json << "  \"gpu_stage_ms\": {";
+        bool first = true;
+        for (const Stage &stage : stages)
+        {
+            if (stage.gpuFrames == 0)
+                continue;
+            json << (first ? "" : ", ") << "\"" << stage.name << "\": " << stage.gpuMs / stage.gpuFrames;
+            first = false;
+        }
+        json << "},\n";
+
+        json << "  \"draw_calls\": " << counterJson(std::vector<double>(drawCalls.begin(), drawCalls.end())) << ",\n";
+        json << "  \"triangles\": " << counterJson(std::vector<double>(triangles.begin(), triangles.end())) << ",\n";
+        json << "  \"state_changes\": " << counterJson(std::vector<double>(stateChanges.begin(), stateChanges.end())) << ",\n";
+        json << "  \"skipped_state_changes\": "
+             << counterJson(std::vector<double>(skippedStateChanges.begin(), skippedStateChanges.end())) << "\n";
+        json << "}\n";
+        return json.str();
+    }
+
+    // prints the report and writes it to path if one is given
+    void writeReport(const std::string &path) const
+    {
+        std::string json = report();
+        std::cout << json;
+        if (!path.empty())
+        {
+            std::ofstream file(path);
+            file << json;
+            if (!file)
+                std::cout << "BENCHMARK:: cannot write " << path << std::endl;
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Keyframe {
+        glm::vec3 position;
+        float yaw, pitch;
+    };
+
+    // summed over the measured frames
+    struct Stage {
+        std::string name;
+        double cpuMs = 0.0, gpuMs = 0.0;
+        unsigned int gpuFrames = 0;
+    };
+
+    // shaders, texture uploads and driver caches settle before anything is measured
+    static const unsigned int WARMUP_FRAMES = 30;
+
+    unsigned int frames, width, height;
+    unsigned int frame = 0;
+    unsigned int framebuffer = 0, renderbuffers[2] = {0, 0};
+    Clock::time_point frameStart = Clock::now();
+    std::vector<Stage> stages;
+    std::vector<std::pair<std::string, double>> startup;
+    std::vector<double> frameTimes;
+    std::vector<unsigned int> drawCalls;
+    std::vector<uint64_t> triangles;
+    std::vector<unsigned int> stateChanges, skippedStateChanges;
+
+    Stage& findStage(const std::string &name)
+    {
+        for (Stage &stage : stages)
+            if (stage.name == name)
+                return stage;
+        stages.push_back(Stage());
+        stages.back().name = name;
+        return stages.back();
+    }
+
+    // nearest rank percentile of sorted values
+    static double percentile(const std::vector<double> &sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        size_t rank = (size_t)std::ceil(p * sorted.size());
+        return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+    }
+
+    static std::string counterJson(std::vector<double> values)
+    {
+        std::sort(values.begin(), values.end());
+        double total = 0.0;
+        for (double value : values)
+            total += value;
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(1);
+        json << "{\"mean\": " << total / std::max(values.size(), (size_t)1) << ", \"min\": " << percentile(values, 0.0)
+             << ", \"max\": " << percentile(values, 1.0) << "}";
+        return json.str();
+    }
+
+    static std::string glString(GLenum name)
+    {
+        const GLubyte *value = glGetString(name);
+        std::string result = value ? (const char*)value : "unknown";
+        std::replace(result.begin(), result.end(), '"', '\'');
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// S3TC is not part of core OpenGL 3.3 and our glad loader was generated without extensions,
+// but every desktop driver exposes EXT_texture_compression_s3tc.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+// the sRGB variants come from EXT_texture_sRGB, exposed wherever S3TC is
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT       0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// Block compressed image with its full (or partial) mip chain, as stored in a .dds file.
+// Supports DXT1/3/5 (BC1-3) and ATI1/ATI2 (BC4/BC5), both with legacy FourCC and DX10 headers.
+struct DDSImage {
+    struct Level {
+        unsigned int width, height;
+        size_t offset, size;
+    };
+
+    GLenum format = 0;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    std::vector<Level> levels;
+    std::vector<unsigned char> data; // blocks of all levels, largest level first
+    // the blocks when parse() was told not to copy them, they stay owned by the caller
+    const unsigned char *external = nullptr;
+
+    const unsigned char* blocks() const
+    {
+        return external ? external : data.data();
+    }
+
+    bool load(const std::string &path)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        std::vector<unsigned char> bytes;
+        unsigned char chunk[1 << 16];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+            bytes.insert(bytes.end(), chunk, chunk + read);
+        fclose(file);
+        if (!parse(bytes.data(), bytes.size()))
+        {
+            std::cout << "DDS:: unsupported or corrupt file " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // with copy = false the image points into bytes, which must outlive it (e.g. a mapped AssetPackage)
+    bool parse(const unsigned char *bytes, size_t size, bool copy = true)
+    {
+        if (size < 4 + sizeof(Header) || memcmp(bytes, "DDS ", 4) != 0)
+            return false;
+        Header header;
+        memcpy(&header, bytes + 4, sizeof(header));
+        if (header.size != 124 || header.pixelFormat.size != 32)
+            return false;
+        size_t offset = 4 + sizeof(Header);
+
+        uint32_t fourCC = header.pixelFormat.flags & DDPF_FOURCC ? header.pixelFormat.fourCC : 0;
+        if (fourCC == makeFourCC('D', 'X', 'T', '1'))
+            format = header.pixelFormat.flags & DDPF_ALPHAPIXELS ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        else if (fourCC == makeFourCC('D', 'X', 'T', '3'))
+            format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        else if (fourCC == makeFourCC('D', 'X', 'T', '5'))
+            format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        else if (fourCC == makeFourCC('A', 'T', 'I', '1') || fourCC == makeFourCC('B', 'C', '4', 'U'))
+            format = GL_COMPRESSED_RED_RGTC1;
+        else if (fourCC == makeFourCC('A', 'T', 'I', '2') || fourCC == makeFourCC('B', 'C', '5', 'U'))
+            format = GL_COMPRESSED_RG_RGTC2;
+        else if (fourCC == makeFourCC('D', 'X', '1', '0'))
+        {
+            uint32_t dxgiFormat;
+            if (size < offset + 20)
+                return false;
+            memcpy(&dxgiFormat, bytes + offset, sizeof(dxgiFormat));
+            offset += 20;
+            format = formatFromDXGI(dxgiFormat);
+        }
+        else
+            format = 0;
+        if (format == 0)
+            return false;
+
+        width = header.width;
+        height = header.height;
+        unsigned int mipCount = header.flags & DDSD_MIPMAPCOUNT && header.mipMapCount > 0 ? header.mipMapCount : 1;
+
+        levels.clear();
+        size_t dataSize = 0;
+        unsigned int w = width, h = height;
+        for (unsigned int i = 0; i < mipCount && (w > 0 || h > 0); i++)
+        {
+            w = w > 0 ? w : 1;
+            h = h > 0 ? h : 1;
+            Level level = {w, h, dataSize, levelSize(format, w, h)};
+            levels.push_back(level);
+            dataSize += level.size;
+            w /= 2;
+            h /= 2;
+        }
+        if (levels.empty() || size - offset < dataSize)
+            return false;
+        if (copy)
+        {
+            data.assign(bytes + offset, bytes + offset + dataSize);
+            external = nullptr;
+        }
+        else
+        {
+            data.clear();
+            external = bytes + offset;
+        }
+        return true;
+    }
+
+    // uploads every stored level to the texture bound to target, must be called on the GL thread.
+    // srgb decodes the color blocks as sRGB, like GL_SRGB8_ALPHA8 does for uncompressed images;
+    // BC4/BC5 have no sRGB variant and stay linear, as one and two channel images do.
+    void upload(GLenum target = GL_TEXTURE_2D, bool srgb = false) const
+    {
+        GLenum internalFormat = srgb ? srgbFormat(format) : format;
+        for (unsigned int i = 0; i < levels.size(); i++)
+        {
+            const Level &level = levels[i];
+            glCompressedTexImage2D(target, (GLint)i, internalFormat, (GLsizei)level.width, (GLsizei)level.height, 0,
+                                   (GLsizei)level.size, blocks() + level.offset);
+        }
+        glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+    }
+
+    static GLenum srgbFormat(GLenum format)
+    {
+        switch (format)
+        {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:  return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+            default: return format;
+        }
+    }
+
+    // bytes per 4x4 block
+    static size_t blockSize(GLenum format)
+    {
+        return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+               || format == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+    }
+
+    static size_t levelSize(GLenum format, unsigned int width, unsigned int height)
+    {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockSize(format);
+    }
+
+    // writes levels (largest first, tightly packed blocks) as a legacy FourCC .dds file
+    static bool write(const std::string &path, GLenum format, unsigned int width, unsigned int height,
+                      const std::vector<std::vector<unsigned char>> &mips)
+    {
+        std::vector<unsigned char> bytes;
+        if (!encode(format, width, height, mips, bytes))
+            return false;
+        std::string temporaryPath = path + ".tmp";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (!file)
+            return false;
+        bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        written = fclose(file) == 0 && written;
+        if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0)
+        {
+            remove(temporaryPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // the contents of the .dds file write() produces
+    static bool encode(GLenum format, unsigned int width, unsigned int height, const std::vector<std::vector<unsigned char>> &mips,
+                       std::vector<unsigned char> &bytes)
+    {
+        Header header;
+        memset(&header, 0, sizeof(header));
+        header.size = 124;
+        header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+        header.height = height;
+        header.width = width;
+        header.pitchOrLinearSize = mips.empty() ? 0 : (uint32_t)mips[0].size();
+        header.mipMapCount = (uint32_t)mips.size();
+        header.pixelFormat.size = 32;
+        header.pixelFormat.flags = DDPF_FOURCC;
+        header.caps = DDSCAPS_TEXTURE | (mips.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+        switch (format)
+        {
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+                header.pixelFormat.flags |= DDPF_ALPHAPIXELS;
+                // fall through
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: header.pixelFormat.fourCC = makeFourCC('D', 'X', 'T', '1'); break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: header.pixelFormat.fourCC = makeFourCC('D', 'X', 'T', '3'); break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: header.pixelFormat.fourCC = makeFourCC('D', 'X', 'T', '5'); break;
+            case GL_COMPRESSED_RED_RGTC1: header.pixelFormat.fourCC = makeFourCC('A', 'T', 'I', '1'); break;
+            case GL_COMPRESSED_RG_RGTC2: header.pixelFormat.fourCC = makeFourCC('A', 'T', 'I', '2'); break;
+            default: return false;
+        }
+
+        const unsigned char *headerBytes = (const unsigned char*)&header;
+        bytes.assign((const unsigned char*)"DDS ", (const unsigned char*)"DDS " + 4);
+        bytes.insert(bytes.end(), headerBytes, headerBytes + sizeof(header));
+        for (const std::vector<unsigned char> &mip : mips)
+            bytes.insert(bytes.end(), mip.begin(), mip.end());
+        return true;
+    }
+
+private:
+    struct PixelFormat {
+        uint32_t size, flags, fourCC, rgbBitCount, rBitMask, gBitMask, bBitMask, aBitMask;
+    };
+    struct Header {
+        uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount;
+        uint32_t reserved1[11];
+        PixelFormat pixelFormat;
+        uint32_t caps, caps2, caps3, caps4, reserved2;
+    };
+
+    enum : uint32_t {
+        DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000,
+        DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000,
+        DDPF_ALPHAPIXELS = 0x1, DDPF_FOURCC = 0x4,
+        DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000
+    };
+
+    static uint32_t makeFourCC(char a, char b, char c, char d)
+    {
+        return (uint32_t)(unsigned char)a | (uint32_t)(unsigned char)b << 8 | (uint32_t)(unsigned char)c << 16 | (uint32_t)(unsigned char)d << 24;
+    }
+
+    static GLenum formatFromDXGI(uint32_t dxgiFormat)
+    {
+        switch (dxgiFormat)
+        {
+            case 70: case 71: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; // BC1_TYPELESS / BC1_UNORM
+            case 73: case 74: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; // BC2
+            case 76: case 77: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; // BC3
+            case 79: case 80: return GL_COMPRESSED_RED_RGTC1;          // BC4
+            case 82: case 83: return GL_COMPRESSED_RG_RGTC2;           // BC5
+            default: return 0;
+        }
+    }
+};
+
+#endif
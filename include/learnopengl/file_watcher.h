@@ -0,0 +1,149 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+// Reports files written in a set of watched directories, for reloading assets while the program runs. A thread
+// blocks on inotify and collects the paths (directory + '/' + name, as the directory was passed to watch());
+// changes() hands them to the caller once no further write came in for SETTLE_MS, so an editor saving in
+// several steps causes one reload. Files replaced by a rename, as many editors save, are reported as well.
+// Without inotify (anything but Linux) nothing is ever reported.
+//
+//   watcher.watch("resources/shaders");
+//   for (const std::string &path : watcher.changes())  // once per frame
+//       ...
+class FileWatcher
+{
+public:
+    static const int SETTLE_MS = 150;
+
+    FileWatcher()
+    {
+#ifdef __linux__
+        notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (notify < 0 || pipe(wakeUp) != 0)
+        {
+            std::cout << "FILE_WATCHER:: inotify is not available, files are not watched" << std::endl;
+            return;
+        }
+        thread = std::thread([this]() { watchLoop(); });
+#endif
+    }
+
+    ~FileWatcher()
+    {
+#ifdef __linux__
+        if (thread.joinable())
+        {
+            char stop = 0;
+            if (write(wakeUp[1], &stop, 1) == 1)
+                thread.join();
+            else
+                thread.detach();
+            close(wakeUp[0]);
+            close(wakeUp[1]);
+        }
+        if (notify >= 0)
+            close(notify);
+#endif
+    }
+
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher& operator=(const FileWatcher &) = delete;
+
+    // reports the files written in directory from now on, subdirectories are not included
+    bool watch(const std::string &directory)
+    {
+#ifdef __linux__
+        if (notify < 0)
+            return false;
+        int descriptor = inotify_add_watch(notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (descriptor < 0)
+        {
+            std::cout << "FILE_WATCHER:: cannot watch " << directory << std::endl;
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        directories[descriptor] = directory;
+        return true;
+#else
+        (void)directory;
+        return false;
+#endif
+    }
+
+    // files whose last write settled since the previous call, each once
+    std::vector<std::string> changes()
+    {
+        std::vector<std::string> settled;
+        Clock::time_point settledBefore = Clock::now() - std::chrono::milliseconds(settleMs);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::map<std::string, Clock::time_point>::iterator change = written.begin(); change != written.end();)
+        {
+            if (change->second > settledBefore)
+            {
+                ++change;
+                continue;
+            }
+            settled.push_back(change->first);
+            change = written.erase(change);
+        }
+        return settled;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // SETTLE_MS itself would need a definition outside the class once std::chrono takes it by reference
+    const int settleMs = SETTLE_MS;
+    std::mutex mutex;
+    // watch descriptor -> directory, and the files written with the time of their last write, under the mutex
+    std::map<int, std::string> directories;
+    std::map<std::string, Clock::time_point> written;
+    int notify = -1;
+    int wakeUp[2] = {-1, -1};
+    std::thread thread;
+
+#ifdef __linux__
+    void watchLoop()
+    {
+        alignas(struct inotify_event) char buffer[4096];
+        while (true)
+        {
+            struct pollfd sources[2] = {{notify, POLLIN, 0}, {wakeUp[0], POLLIN, 0}};
+            if (poll(sources, 2, -1) < 0)
+                continue;
+            if (sources[1].revents)
+                return;
+            ssize_t length;
+            while ((length = read(notify, buffer, sizeof(buffer))) > 0)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (char *cursor = buffer; cursor < buffer + length;)
+                {
+                    const struct inotify_event *event = (const struct inotify_event*)cursor;
+                    cursor += sizeof(struct inotify_event) + event->len;
+                    std::map<int, std::string>::iterator directory = directories.find(event->wd);
+                    if (event->len == 0 || directory == directories.end())
+                        continue;
+                    written[directory->second + '/' + event->name] = Clock::now();
+                }
+            }
+        }
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// axis aligned bounding box in the space of the vertices it was built from
+struct BoundingBox {
+    glm::vec3 min = glm::vec3(1e30f);
+    glm::vec3 max = glm::vec3(-1e30f);
+
+    bool empty() const
+    {
+        return min.x > max.x;
+    }
+
+    void expand(const glm::vec3 &point)
+    {
+        min = glm::vec3(std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z));
+        max = glm::vec3(std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z));
+    }
+
+    void expand(const BoundingBox &box)
+    {
+        if (!box.empty())
+        {
+            expand(box.min);
+            expand(box.max);
+        }
+    }
+
+    glm::vec3 center() const
+    {
+        return (min + max) * 0.5f;
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    // the sphere under an affine transform, non uniform scale grows the radius by the largest axis scale
+    BoundingSphere transformed(const glm::mat4 &model) const
+    {
+        BoundingSphere result;
+        result.center = glm::vec3(model * glm::vec4(center, 1.0f));
+        float scale = std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                               std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+                                        glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+        result.radius = radius * std::sqrt(scale);
+        return result;
+    }
+
+    // sphere around the box center that tightly encloses the given points
+    static BoundingSphere around(const BoundingBox &box, const glm::vec3 *points, size_t count, size_t stride)
+    {
+        BoundingSphere sphere;
+        sphere.center = box.center();
+        float radiusSquared = 0.0f;
+        const char *bytes = (const char*)points;
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 offset = *(const glm::vec3*)(bytes + i * stride) - sphere.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        sphere.radius = std::sqrt(radiusSquared);
+        return sphere;
+    }
+
+    // sphere around the box center enclosing all given spheres
+    static BoundingSphere around(const BoundingBox &box, const std::vector<BoundingSphere> &spheres)
+    {
+        BoundingSphere sphere;
+        sphere.center = box.center();
+        for (const BoundingSphere &other : spheres)
+            sphere.radius = std::max(sphere.radius, glm::length(other.center - sphere.center) + other.radius);
+        return sphere;
+    }
+};
+
+// the six clip planes of a view-projection matrix, normals pointing inside
+class Frustum
+{
+public:
+    glm::vec4 planes[6];
+
+    Frustum() {}
+
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        // rows of the (column major) matrix
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        planes[0] = row[3] + row[0]; // left
+        planes[1] = row[3] - row[0]; // right
+        planes[2] = row[3] + row[1]; // bottom
+        planes[3] = row[3] - row[1]; // top
+        planes[4] = row[3] + row[2]; // near
+        planes[5] = row[3] - row[2]; // far
+        for (glm::vec4 &plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    bool intersects(const BoundingSphere &sphere) const
+    {
+        for (const glm::vec4 &plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+                return false;
+        }
+        return true;
+    }
+
+    // conservative test of a model space box transformed by model
+    bool intersects(const BoundingBox &box, const glm::mat4 &model) const
+    {
+        glm::vec3 center = glm::vec3(model * glm::vec4(box.center(), 1.0f));
+        glm::vec3 halfExtent = (box.max - box.min) * 0.5f;
+        glm::vec3 axisX = glm::vec3(model[0]) * halfExtent.x;
+        glm::vec3 axisY = glm::vec3(model[1]) * halfExtent.y;
+        glm::vec3 axisZ = glm::vec3(model[2]) * halfExtent.z;
+        for (const glm::vec4 &plane : planes)
+        {
+            glm::vec3 normal(plane);
+            float radius = std::fabs(glm::dot(normal, axisX)) + std::fabs(glm::dot(normal, axisY)) + std::fabs(glm::dot(normal, axisZ));
+            if (glm::dot(normal, center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/render_stats.h>
+
+// Shadow copy of the GL state the renderer changes per draw: program, vertex array, the textures of every unit,
+// the uniform buffer ranges of the first binding points, the enabled capabilities and the depth, blend and cull
+// settings. A call that would set the value already in place is dropped and counted in
+// RenderStats::skippedStateChanges.
+//
+// The copy is only right as long as every change of this state goes through GLState::instance(). Code that
+// changes it behind the cache's back (or deletes a bound object) has to call invalidate() afterwards; the imgui
+// backend restores everything it touches, so it needs no invalidate().
+class GLState
+{
+public:
+    static const unsigned int TEXTURE_UNITS = 16;
+    static const unsigned int UNIFORM_BINDINGS = 8;
+
+    static GLState& instance()
+    {
+        static GLState state;
+        return state;
+    }
+
+    // forgets everything, the next call of every kind reaches GL
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < TEXTURE_UNITS; unit++)
+            for (unsigned int target = 0; target < TARGETS; target++)
+                textures[unit][target] = UNKNOWN;
+        for (unsigned int capability = 0; capability < CAPABILITIES; capability++)
+            capabilities[capability] = -1;
+        depthFunction = UNKNOWN;
+        depthWrites = -1;
+        colorWrites = -1;
+        blendSource = blendDestination = UNKNOWN;
+        culledFace = UNKNOWN;
+        for (unsigned int binding = 0; binding < UNIFORM_BINDINGS; binding++)
+            uniformBuffers[binding].buffer = UNKNOWN;
+    }
+
+    void useProgram(GLuint id)
+    {
+        if (changed(program, id))
+            glUseProgram(id);
+    }
+
+    void bindVertexArray(GLuint id)
+    {
+        if (changed(vertexArray, id))
+            glBindVertexArray(id);
+    }
+
+    // unit is an index, not GL_TEXTUREi
+    void activeTexture(unsigned int unit)
+    {
+        if (changed(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // binds to the active unit
+    void bindTexture(GLenum target, GLuint id)
+    {
+        int index = targetIndex(target);
+        if (index >= 0 && activeUnit < TEXTURE_UNITS)
+        {
+            if (changed(textures[activeUnit][index], id))
+                glBindTexture(target, id);
+            return;
+        }
+        // the unit isn't known, so neither is which cached binding this replaces
+        if (index >= 0)
+        {
+            for (unsigned int unit = 0; unit < TEXTURE_UNITS; unit++)
+                textures[unit][index] = UNKNOWN;
+        }
+        issue();
+        glBindTexture(target, id);
+    }
+
+    // binds to unit, the active unit only changes if the binding does
+    void bindTexture(unsigned int unit, GLenum target, GLuint id)
+    {
+        int index = targetIndex(target);
+        if (index >= 0 && unit < TEXTURE_UNITS && textures[unit][index] == id)
+        {
+            RenderStats::frame().skippedStateChanges++;
+            return;
+        }
+        activeTexture(unit);
+        bindTexture(target, id);
+    }
+
+    // deleting a texture unbinds it from every unit, and a later texture may get the same name
+    void deleteTexture(GLuint id)
+    {
+        for (unsigned int unit = 0; unit < TEXTURE_UNITS; unit++)
+            for (unsigned int target = 0; target < TARGETS; target++)
+                if (textures[unit][target] == id)
+                    textures[unit][target] = 0;
+        glDeleteTextures(1, &id);
+    }
+
+    // a later program may get the name of a deleted one
+    void deleteProgram(GLuint id)
+    {
+        if (program == id)
+            program = UNKNOWN;
+        glDeleteProgram(id);
+    }
+
+    // the same for vertex arrays
+    void deleteVertexArray(GLuint id)
+    {
+        if (vertexArray == id)
+            vertexArray = UNKNOWN;
+        glDeleteVertexArrays(1, &id);
+    }
+
+    // binds size bytes of buffer from offset to the uniform block binding point index
+    void bindUniformBuffer(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        if (index < UNIFORM_BINDINGS)
+        {
+            UniformRange &range = uniformBuffers[index];
+            if (range.buffer == buffer && range.offset == offset && range.size == size)
+            {
+                RenderStats::frame().skippedStateChanges++;
+                return;
+            }
+            range.buffer = buffer;
+            range.offset = offset;
+            range.size = size;
+        }
+        issue();
+        glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+    }
+
+    // deleting a buffer unbinds it from every binding point, and a later buffer may get the same name
+    void deleteBuffer(GLuint id)
+    {
+        for (unsigned int binding = 0; binding < UNIFORM_BINDINGS; binding++)
+            if (uniformBuffers[binding].buffer == id)
+                uniformBuffers[binding].buffer = 0;
+        glDeleteBuffers(1, &id);
+    }
+
+    // GL_CULL_FACE, GL_DEPTH_TEST and GL_BLEND are cached, other capabilities go straight to GL
+    void enable(GLenum capability)
+    {
+        set(capability, true);
+    }
+
+    void disable(GLenum capability)
+    {
+        set(capability, false);
+    }
+
+    void set(GLenum capability, bool enabled)
+    {
+        int index = capabilityIndex(capability);
+        if (index >= 0 && !changed(capabilities[index], enabled ? 1 : 0))
+            return;
+        if (index < 0)
+            issue();
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    void depthFunc(GLenum function)
+    {
+        if (changed(depthFunction, function))
+            glDepthFunc(function);
+    }
+
+    void depthMask(bool writes)
+    {
+        if (changed(depthWrites, writes ? 1 : 0))
+            glDepthMask(writes ? GL_TRUE : GL_FALSE);
+    }
+
+    // all four channels at once, off for passes that only fill the depth buffer
+    void colorMask(bool writes)
+    {
+        if (changed(colorWrites, writes ? 1 : 0))
+        {
+            GLboolean mask = writes ? GL_TRUE : GL_FALSE;
+            glColorMask(mask, mask, mask, mask);
+        }
+    }
+
+    void blendFunc(GLenum source, GLenum destination)
+    {
+        if (blendSource == source && blendDestination == destination)
+        {
+            RenderStats::frame().skippedStateChanges++;
+            return;
+        }
+        blendSource = source;
+        blendDestination = destination;
+        issue();
+        glBlendFunc(source, destination);
+    }
+
+    void cullFace(GLenum face)
+    {
+        if (changed(culledFace, face))
+            glCullFace(face);
+    }
+
+private:
+    static const unsigned int UNKNOWN = ~0u;
+    // GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BUFFER
+    static const unsigned int TARGETS = 4;
+    // GL_CULL_FACE, GL_DEPTH_TEST, GL_BLEND
+    static const unsigned int CAPABILITIES = 3;
+
+    unsigned int program, vertexArray, activeUnit;
+    unsigned int textures[TEXTURE_UNITS][TARGETS];
+    int capabilities[CAPABILITIES];
+    unsigned int depthFunction;
+    int depthWrites;
+    int colorWrites;
+    unsigned int blendSource, blendDestination;
+    unsigned int culledFace;
+    struct UniformRange {
+        unsigned int buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+    UniformRange uniformBuffers[UNIFORM_BINDINGS];
+
+    GLState()
+    {
+        invalidate();
+    }
+
+    // stores value and tells whether the call has to reach GL
+    template <typename T, typename V>
+    static bool changed(T &current, V value)
+    {
+        if (current == (T)value)
+        {
+            RenderStats::frame().skippedStateChanges++;
+            return false;
+        }
+        current = (T)value;
+        issue();
+        return true;
+    }
+
+    static void issue()
+    {
+        RenderStats::frame().stateChanges++;
+    }
+
+    static int targetIndex(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_TEXTURE_2D: return 0;
+            case GL_TEXTURE_CUBE_MAP: return 1;
+            case GL_TEXTURE_2D_ARRAY: return 2;
+            case GL_TEXTURE_BUFFER: return 3;
+            default: return -1;
+        }
+    }
+
+    static int capabilityIndex(GLenum capability)
+    {
+        switch (capability)
+        {
+            case GL_CULL_FACE: return 0;
+            case GL_DEPTH_TEST: return 1;
+            case GL_BLEND: return 2;
+            default: return -1;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,316 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/render_stats.h>
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/uniform_ring.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Point light of limited range, it lights nothing farther than radius from its position (world space)
+struct ClusterLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+};
+
+// Clustered forward shading of many point lights. The view frustum is split into TILES_X x TILES_Y screen tiles
+// and SLICES depth slices spaced exponentially between the near and far plane. Every frame update() bins the
+// lights into these clusters on the thread pool, one slice per task, and uploads three buffer textures the
+// fragment shader reads (GL 3.3 has no storage buffers):
+//   lights   RGBA32F, two texels per light: position and radius, color
+//   grid     RG32UI, per cluster the first entry in the index list and the number of lights
+//   indices  R16UI, the lights of every cluster one after another
+// A fragment finds its cluster from gl_FragCoord and its view depth and only shades the lights listed there,
+// see CalcClusterLights in scene_light.fs. The grid parameters go through the Clusters uniform block.
+//
+//   clusters.clear();
+//   clusters.add(position, radius, color);  // any number of lights
+//   clusters.update(ring, view, projection, viewportWidth, viewportHeight);
+//
+// The projection must be a symmetric perspective one like glm::perspective.
+class LightClusters
+{
+public:
+    static const unsigned int TILES_X = 16;
+    static const unsigned int TILES_Y = 9;
+    static const unsigned int SLICES = 24;
+    static const unsigned int CLUSTERS = TILES_X * TILES_Y * SLICES;
+    // lights are referenced by 16 bit indices
+    static const size_t MAX_LIGHTS = 65536;
+    // units of the lights, grid and indices buffer textures, above the material units of Mesh
+    static const unsigned int LIGHTS_TEXTURE_UNIT = 12;
+    static const unsigned int GRID_TEXTURE_UNIT = 13;
+    static const unsigned int INDICES_TEXTURE_UNIT = 14;
+    static const GLuint BLOCK_BINDING = 3;
+
+    std::vector<ClusterLight> lights;
+
+    LightClusters()
+    {
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        maxIndices = maxTexels > 0 ? (size_t)maxTexels : 65536;
+        glGenBuffers(BUFFERS, buffers);
+        glGenTextures(BUFFERS, textures);
+        const GLenum formats[BUFFERS] = {GL_RGBA32F, GL_RG32UI, GL_R16UI};
+        for (unsigned int i = 0; i < BUFFERS; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            GLState::instance().bindTexture(LIGHTS_TEXTURE_UNIT + i, GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        grid.resize(CLUSTERS * 2);
+    }
+
+    ~LightClusters()
+    {
+        release();
+    }
+
+    // deletes the buffer textures, must be called while the context is still current (the destructor does it
+    // too, for clusters that go away before the context)
+    void release()
+    {
+        if (!textures[0])
+            return;
+        for (unsigned int i = 0; i < BUFFERS; i++)
+            GLState::instance().deleteTexture(textures[i]);
+        glDeleteBuffers(BUFFERS, buffers);
+        std::fill(textures, textures + BUFFERS, 0u);
+        std::fill(buffers, buffers + BUFFERS, 0u);
+    }
+
+    LightClusters(const LightClusters &) = delete;
+    LightClusters& operator=(const LightClusters &) = delete;
+
+    void clear()
+    {
+        lights.clear();
+    }
+
+    void add(const glm::vec3 &position, float radius, const glm::vec3 &color)
+    {
+        if (lights.size() < MAX_LIGHTS)
+            lights.push_back(ClusterLight{position, radius, color});
+    }
+
+    // bins the lights for this camera, uploads the buffers, binds them to their units and writes the Clusters
+    // block to the ring. Must be called on the GL thread before the draws that shade the lights.
+    void update(UniformRing &ring, const glm::mat4 &view, const glm::mat4 &projection, int viewportWidth, int viewportHeight,
+                ThreadPool &pool = ThreadPool::shared())
+    {
+        // near and far plane of a GL perspective matrix
+        float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+        float farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+        scaleX = projection[0][0];
+        scaleY = projection[1][1];
+        float logDepth = std::log(farPlane / nearPlane);
+        for (unsigned int slice = 0; slice <= SLICES; slice++)
+            sliceDepths[slice] = nearPlane * std::exp(logDepth * (float)slice / (float)SLICES);
+
+        // view space spheres, binSlice drops the ones outside of the frustum
+        viewLights.resize(lights.size());
+        pool.parallelFor(lights.size(), 1024, [this, &view](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(lights[i].position, 1.0f)), lights[i].radius);
+        });
+
+        pool.parallelFor(SLICES, 1, [this](size_t begin, size_t end) {
+            for (size_t slice = begin; slice < end; slice++)
+                binSlice((unsigned int)slice);
+        });
+
+        // concatenate the index lists of the slices
+        indices.clear();
+        bool truncated = false;
+        for (unsigned int slice = 0; slice < SLICES; slice++)
+        {
+            const Slice &binned = slices[slice];
+            uint32_t base = (uint32_t)indices.size();
+            size_t count = binned.indices.size();
+            if (indices.size() + count > maxIndices)
+            {
+                count = maxIndices - indices.size();
+                truncated = true;
+            }
+            indices.insert(indices.end(), binned.indices.begin(), binned.indices.begin() + count);
+            for (unsigned int cluster = 0; cluster < TILES_X * TILES_Y; cluster++)
+            {
+                uint32_t first = binned.offsets[cluster];
+                uint32_t lightCount = binned.offsets[cluster + 1] - first;
+                if (first + lightCount > count)
+                    lightCount = first < count ? (uint32_t)count - first : 0;
+                uint32_t *entry = &grid[2 * (slice * TILES_X * TILES_Y + cluster)];
+                entry[0] = base + first;
+                entry[1] = lightCount;
+            }
+        }
+        if (truncated && !warnedTruncated)
+        {
+            std::cout << "LIGHT_CLUSTERS:: more than " << maxIndices << " light references, some clusters lose lights" << std::endl;
+            warnedTruncated = true;
+        }
+
+        upload();
+
+        Block block;
+        block.tileScale = glm::vec2((float)TILES_X / (float)std::max(viewportWidth, 1), (float)TILES_Y / (float)std::max(viewportHeight, 1));
+        block.sliceScale = (float)SLICES / logDepth;
+        block.sliceBias = -std::log(nearPlane) * block.sliceScale;
+        block.countX = TILES_X;
+        block.countY = TILES_Y;
+        block.countZ = SLICES;
+        block.lightCount = (GLint)lights.size();
+        ring.bind(BLOCK_BINDING, ring.write(&block, sizeof(block)), sizeof(block));
+
+        RenderStats::frame().lights += (unsigned int)lights.size();
+        RenderStats::frame().lightReferences += (unsigned int)indices.size();
+    }
+
+    // light references of the last update, a light counts once for every cluster it touches
+    size_t referenceCount() const
+    {
+        return indices.size();
+    }
+
+private:
+    static const unsigned int BUFFERS = 3;
+
+    // std140 mirror of the Clusters block in scene_light.fs
+    struct Block {
+        glm::vec2 tileScale;
+        float sliceScale, sliceBias;
+        GLint countX, countY, countZ, lightCount;
+    };
+
+    // lists of one depth slice, written by one task
+    struct Slice {
+        // light of each reference, with the cluster of the slice it belongs to in the upper bits until sorted
+        std::vector<uint32_t> references;
+        std::vector<uint16_t> indices;
+        // where the lights of every cluster of the slice start in indices, one past the end for the last
+        uint32_t offsets[TILES_X * TILES_Y + 1];
+    };
+
+    GLuint buffers[BUFFERS], textures[BUFFERS];
+    size_t maxIndices;
+    bool warnedTruncated = false;
+    float scaleX = 1.0f, scaleY = 1.0f;
+    float sliceDepths[SLICES + 1];
+    std::vector<glm::vec4> viewLights;
+    Slice slices[SLICES];
+    std::vector<uint32_t> grid;
+    std::vector<uint16_t> indices;
+    std::vector<glm::vec4> lightTexels;
+
+    // finds the clusters of one slice every light sphere touches and sorts the references by cluster
+    void binSlice(unsigned int slice)
+    {
+        Slice &binned = slices[slice];
+        binned.references.clear();
+        float sliceNear = sliceDepths[slice], sliceFar = sliceDepths[slice + 1];
+
+        // view space x and y of the tile borders at unit depth
+        float tileX[TILES_X + 1], tileY[TILES_Y + 1];
+        for (unsigned int x = 0; x <= TILES_X; x++)
+            tileX[x] = (2.0f * (float)x / (float)TILES_X - 1.0f) / scaleX;
+        for (unsigned int y = 0; y <= TILES_Y; y++)
+            tileY[y] = (2.0f * (float)y / (float)TILES_Y - 1.0f) / scaleY;
+
+        for (size_t i = 0; i < viewLights.size(); i++)
+        {
+            glm::vec3 center(viewLights[i]);
+            float radius = viewLights[i].w;
+            float depth = -center.z;
+            // part of the sphere's depth range inside the slice
+            float depthNear = std::max(sliceNear, depth - radius), depthFar = std::min(sliceFar, depth + radius);
+            if (depthNear > depthFar)
+                continue;
+
+            // tiles covered by the sphere's bounding box cut to that depth range, projecting its corners
+            int firstX, lastX, firstY, lastY;
+            if (!tileRange(center.x - radius, center.x + radius, depthNear, depthFar, scaleX, TILES_X, firstX, lastX)
+                || !tileRange(center.y - radius, center.y + radius, depthNear, depthFar, scaleY, TILES_Y, firstY, lastY))
+                continue;
+
+            // exact test of the sphere against the bounding box of each cluster
+            float dz = std::max(0.0f, std::max(sliceNear - depth, depth - sliceFar));
+            for (int y = firstY; y <= lastY; y++)
+            {
+                float minY = std::min(tileY[y] * sliceNear, tileY[y] * sliceFar);
+                float maxY = std::max(tileY[y + 1] * sliceNear, tileY[y + 1] * sliceFar);
+                float dy = std::max(0.0f, std::max(minY - center.y, center.y - maxY));
+                for (int x = firstX; x <= lastX; x++)
+                {
+                    float minX = std::min(tileX[x] * sliceNear, tileX[x] * sliceFar);
+                    float maxX = std::max(tileX[x + 1] * sliceNear, tileX[x + 1] * sliceFar);
+                    float dx = std::max(0.0f, std::max(minX - center.x, center.x - maxX));
+                    if (dx * dx + dy * dy + dz * dz <= radius * radius)
+                        binned.references.push_back(((uint32_t)(y * TILES_X + x) << 16) | (uint32_t)i);
+                }
+            }
+        }
+
+        // counting sort by cluster, the lights of a cluster stay in order
+        std::fill(binned.offsets, binned.offsets + TILES_X * TILES_Y + 1, 0u);
+        for (uint32_t reference : binned.references)
+            binned.offsets[(reference >> 16) + 1]++;
+        for (unsigned int cluster = 0; cluster < TILES_X * TILES_Y; cluster++)
+            binned.offsets[cluster + 1] += binned.offsets[cluster];
+        binned.indices.resize(binned.references.size());
+        uint32_t cursor[TILES_X * TILES_Y];
+        std::copy(binned.offsets, binned.offsets + TILES_X * TILES_Y, cursor);
+        for (uint32_t reference : binned.references)
+            binned.indices[cursor[reference >> 16]++] = (uint16_t)(reference & 0xFFFF);
+    }
+
+    // tiles along one axis that the box [low, high] x [depthNear, depthFar] projects to, false if none
+    static bool tileRange(float low, float high, float depthNear, float depthFar, float scale, unsigned int tiles,
+                          int &first, int &last)
+    {
+        // in front of the camera the projection of a box spans the projections of its corners
+        float ndcMin = std::min(std::min(low / depthNear, low / depthFar), std::min(high / depthNear, high / depthFar)) * scale;
+        float ndcMax = std::max(std::max(low / depthNear, low / depthFar), std::max(high / depthNear, high / depthFar)) * scale;
+        if (ndcMax < -1.0f || ndcMin > 1.0f)
+            return false;
+        first = std::max(0, (int)std::floor((ndcMin * 0.5f + 0.5f) * (float)tiles));
+        last = std::min((int)tiles - 1, (int)std::floor((ndcMax * 0.5f + 0.5f) * (float)tiles));
+        return first <= last;
+    }
+
+    // orphans the three buffers and fills them, then binds their textures
+    void upload()
+    {
+        lightTexels.resize(std::max<size_t>(2 * lights.size(), 1));
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            lightTexels[2 * i] = glm::vec4(lights[i].position, lights[i].radius);
+            lightTexels[2 * i + 1] = glm::vec4(lights[i].color, 0.0f);
+        }
+        fill(0, lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+        fill(1, grid.data(), grid.size() * sizeof(uint32_t));
+        const uint16_t none = 0;
+        fill(2, indices.empty() ? &none : indices.data(), std::max<size_t>(indices.size(), 1) * sizeof(uint16_t));
+        for (unsigned int i = 0; i < BUFFERS; i++)
+            GLState::instance().bindTexture(LIGHTS_TEXTURE_UNIT + i, GL_TEXTURE_BUFFER, textures[i]);
+    }
+
+    void fill(unsigned int buffer, const void *data, size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+        glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+    }
+};
+
+#endif
@@ -5,9 +5,17 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <learnopengl/frustum.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/render_stats.h>
 #include <learnopengl/shader.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 using namespace std;
@@ -27,43 +35,320 @@ struct Vertex {
 
 
 
+// 20 byte GPU layout of a Vertex, used when a mesh is created with packed = true:
+//   position - 16 bit unorm inside the mesh bounds, dequantized with posScale/posOffset of the Draw block;
+//              w holds the tangent handedness (bit 0: 0 = -1, 1 = +1) that replaces the bitangent, and above
+//              it the layer of the mesh in its array textures
+//   normal, tangent - octahedral encoding in two 16 bit snorms
+//   texCoords - half floats
+struct PackedVertex {
+    // the layer shares position[3] with the handedness bit
+    static const unsigned int MAX_LAYERS = 1 << 15;
+
+    uint16_t position[4];
+    int16_t  normal[2];
+    uint16_t texCoords[2];
+    int16_t  tangent[2];
+
+    static PackedVertex pack(const Vertex &vertex, const glm::vec3 &offset, const glm::vec3 &scale, unsigned int layer = 0)
+    {
+        PackedVertex packed;
+        for (int i = 0; i < 3; i++)
+            packed.position[i] = scale[i] > 0.0f ? glm::packUnorm1x16((vertex.Position[i] - offset[i]) / scale[i]) : 0;
+        float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent);
+        packed.position[3] = (uint16_t)(layer << 1 | (handedness < 0.0f ? 0 : 1));
+        octEncode(vertex.Normal, packed.normal);
+        octEncode(vertex.Tangent, packed.tangent);
+        packed.texCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+        packed.texCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+        return packed;
+    }
+
+    // maps the unit sphere onto the [-1, 1] square: the upper half directly, the lower half folded over the corners
+    static void octEncode(const glm::vec3 &direction, int16_t out[2])
+    {
+        float sum = std::fabs(direction.x) + std::fabs(direction.y) + std::fabs(direction.z);
+        float x = sum > 0.0f ? direction.x / sum : 0.0f;
+        float y = sum > 0.0f ? direction.y / sum : 0.0f;
+        if (direction.z < 0.0f)
+        {
+            float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+        out[0] = (int16_t)glm::packSnorm1x16(x);
+        out[1] = (int16_t)glm::packSnorm1x16(y);
+    }
+};
+
+// one level of detail, a range of the mesh indices drawn over the shared vertices
+struct LodLevel {
+    // most levels a mesh has, the first one included
+    static const unsigned int MAX_LEVELS = 4;
+
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    float error; // largest surface deviation from level 0, in model units
+};
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
+    // GL_TEXTURE_2D_ARRAY textures are bound from Mesh::ARRAY_TEXTURE_UNIT on
+    GLenum target = GL_TEXTURE_2D;
+};
+
+// vertex array and buffers that hold the GPU copy of one or more meshes. A Model puts all of its meshes into
+// one of these, each mesh then draws its own range with a base vertex.
+struct MeshBuffers {
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    bool packed = false;
+    // position dequantization of the packed layout, shared by all meshes in the buffers
+    glm::vec3 positionOffset = glm::vec3(0.0f), positionScale = glm::vec3(1.0f);
+    // instance attribute source of the VAO, set by Mesh::setupInstanceAttributes
+    unsigned int instanceBuffer = 0;
+    size_t instanceOffset = 0;
+    // vertex array of the depth pre-pass: only the positions, in their own buffer, and the same indices. 0 if
+    // the model was uploaded without Model::POSITION_STREAM, the depth pass then uses VAO.
+    unsigned int depthVAO = 0, positionVBO = 0;
+    unsigned int depthInstanceBuffer = 0;
+    size_t depthInstanceOffset = 0;
+
+    size_t indexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+    }
+
+    // bytes per vertex of the position-only buffer
+    size_t positionSize() const
+    {
+        return packed ? sizeof(PackedVertex::position) : sizeof(glm::vec3);
+    }
 };
 
 class Mesh {
 public:
+    // first unit of array textures, separate from the units of 2D textures because a sampler2D and a
+    // sampler2DArray of the same program must never point at the same unit
+    static const unsigned int ARRAY_TEXTURE_UNIT = 8;
+
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
 
+    // bounds of the vertices in model space
+    BoundingBox    bounds;
+    BoundingSphere boundingSphere;
+    // level 0 is the full mesh, every further level is a simplified index range stored after it
+    vector<LodLevel> lods;
+
     unsigned int VAO;
+    // the GPU copy uses PackedVertex and, with at most 65536 vertices, 16 bit indices
+    bool packed = false;
     std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // layer of the mesh's maps in its array textures (packed layout only), -1 if it uses plain 2D textures
+    int textureLayer = -1;
+    // constructor. Without upload the mesh has no GPU copy until it is placed in shared buffers with
+    // setBuffers, see Model::uploadMeshes.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+         const BoundingBox &bounds = BoundingBox(), const BoundingSphere &boundingSphere = BoundingSphere(),
+         vector<LodLevel> lods = vector<LodLevel>(), bool packed = false, bool upload = true)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->bounds = bounds;
+        this->boundingSphere = boundingSphere;
+        this->lods = std::move(lods);
+        this->packed = packed;
+        if (this->lods.empty())
+            this->lods.push_back(LodLevel{0, (unsigned int)this->indices.size(), 0.0f});
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (upload)
+            setupMesh();
+    }
+
+    // render the mesh, lod is clamped to the coarsest available level
+    void Draw(Shader &shader, unsigned int lod = 0)
+    {
+        bindTextures(shader);
+
+        // draw mesh
+        // the VAO stays bound, GLState drops the bind if the next draw uses it again
+        const LodLevel &level = lods[std::min(lod, (unsigned int)lods.size() - 1)];
+        GLState::instance().bindVertexArray(VAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, level.indexCount, buffers->indexType, indexPointer(level), baseVertex);
+        RenderStats::frame().draw(level.indexCount / 3);
+    }
+
+    // render instanceCount copies of the mesh, the per-instance model matrices come from the buffer
+    // given to setupInstanceAttributes
+    void DrawInstanced(Shader &shader, unsigned int instanceCount, unsigned int lod = 0)
+    {
+        bindTextures(shader);
+
+        const LodLevel &level = lods[std::min(lod, (unsigned int)lods.size() - 1)];
+        GLState::instance().bindVertexArray(VAO);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.indexCount, buffers->indexType, indexPointer(level), instanceCount, baseVertex);
+        RenderStats::frame().draw((uint64_t)level.indexCount / 3 * instanceCount);
+    }
+
+    // sources attributes 5-8 (one mat4 per instance) from instanceVBO, which stores tightly packed glm::mat4s
+    // starting at offset bytes, in the vertex array of the depth pre-pass with depth. Does nothing if the
+    // attributes already point there.
+    void setupInstanceAttributes(unsigned int instanceVBO, size_t offset = 0, bool depth = false)
+    {
+        unsigned int vertexArray = depthVAO(depth);
+        unsigned int &source = vertexArray == VAO ? buffers->instanceBuffer : buffers->depthInstanceBuffer;
+        size_t &sourceOffset = vertexArray == VAO ? buffers->instanceOffset : buffers->depthInstanceOffset;
+        if (instanceVBO == source && offset == sourceOffset)
+            return;
+        source = instanceVBO;
+        sourceOffset = offset;
+        GLState::instance().bindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(5 + column);
+            glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(5 + column, 1);
+        }
+        GLState::instance().bindVertexArray(0);
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // places the mesh in shared buffers, its vertices start at baseVertex and its indices (relative to
+    // baseVertex) at firstIndex
+    void setBuffers(const std::shared_ptr<MeshBuffers> &buffers, int baseVertex, unsigned int firstIndex)
     {
+        this->buffers = buffers;
+        this->baseVertex = baseVertex;
+        this->firstIndex = firstIndex;
+        VAO = buffers->VAO;
+    }
+
+    const std::shared_ptr<MeshBuffers>& sharedBuffers() const
+    {
+        return buffers;
+    }
+
+    // the position-only vertex array with depth if the buffers have one, else VAO
+    unsigned int depthVAO(bool depth = true) const
+    {
+        return depth && buffers->depthVAO ? buffers->depthVAO : VAO;
+    }
+
+    // binds the textures, the part of a draw that MeshBatch shares between the meshes of a batch. The vertex
+    // layout reaches the scene shaders through their Draw uniform block, see RenderQueue::execute.
+    void bindMaterial(Shader &shader)
+    {
+        bindTextures(shader);
+    }
+
+    // appends the index range of the given level to a multi draw
+    void addRange(unsigned int lod, vector<GLsizei> &counts, vector<const void*> &offsets, vector<GLint> &baseVertices) const
+    {
+        const LodLevel &level = lods[std::min(lod, (unsigned int)lods.size() - 1)];
+        counts.push_back((GLsizei)level.indexCount);
+        offsets.push_back(indexPointer(level));
+        baseVertices.push_back(baseVertex);
+    }
+
+    // must be called when glslIdentifierPrefix changes
+    void resetSamplerLocations()
+    {
+        uniformGeneration = 0;
+    }
+
+    // bytes of vertex and index data in GPU memory
+    size_t gpuBytes() const
+    {
+        size_t positions = buffers->depthVAO ? vertices.size() * buffers->positionSize() : 0;
+        return vertices.size() * (packed ? sizeof(PackedVertex) : sizeof(Vertex)) + positions + indices.size() * buffers->indexSize();
+    }
+
+    // attribute pointers of the float or the packed vertex layout for the bound VAO and GL_ARRAY_BUFFER
+    static void setVertexAttributes(bool packed)
+    {
+        if (packed)
+        {
+            // quantized position + tangent handedness
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+            // octahedral normal
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+            // half float texture coords
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texCoords));
+            // octahedral tangent, the bitangent is rebuilt from normal, tangent and handedness
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, tangent));
+            return;
+        }
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+    }
+
+private:
+    // render data
+    std::shared_ptr<MeshBuffers> buffers = std::make_shared<MeshBuffers>();
+    int baseVertex = 0;
+    unsigned int firstIndex = 0;
+    // Shader::generation of the program the uniform locations were resolved for
+    uint64_t uniformGeneration = 0;
+    vector<GLint> samplerLocations;
+
+    const void* indexPointer(const LodLevel &level) const
+    {
+        return (const void*)((firstIndex + level.indexOffset) * buffers->indexSize());
+    }
+
+    void bindTextures(Shader &shader)
+    {
+        // sampler names only depend on the texture list, their locations are resolved once per program
+        if (uniformGeneration != shader.generation())
+            resolveUniformLocations(shader);
+
         // bind appropriate textures
+        unsigned int planeUnit = 0, arrayUnit = ARRAY_TEXTURE_UNIT;
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // set the sampler to the correct texture unit
+            unsigned int unit = textures[i].target == GL_TEXTURE_2D_ARRAY ? arrayUnit++ : planeUnit++;
+            glUniform1i(samplerLocations[i], unit);
+            // and bind the texture there, nothing happens if it is still bound from the previous mesh
+            GLState::instance().bindTexture(unit, textures[i].target, textures[i].id);
+        }
+    }
+
+    // builds the sampler name of every texture (prefix + type + N, e.g. material.texture_diffuse1) and looks it up in the shader
+    void resolveUniformLocations(Shader &shader)
+    {
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        samplerLocations.resize(textures.size());
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -75,65 +360,147 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplerLocations[i] = shader.getUniformLocation(glslIdentifierPrefix + name + number);
         }
-
-
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        uniformGeneration = shader.generation();
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
         // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        glGenVertexArrays(1, &buffers->VAO);
+        glGenBuffers(1, &buffers->VBO);
+        glGenBuffers(1, &buffers->EBO);
+        buffers->packed = packed;
+        VAO = buffers->VAO;
 
-        glBindVertexArray(VAO);
+        GLState::instance().bindVertexArray(VAO);
+        if (packed)
+        {
+            setupPackedMesh();
+            return;
+        }
         // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers->VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        setVertexAttributes(false);
+
+        GLState::instance().bindVertexArray(0);
+    }
+
+    // uploads the vertices as PackedVertex and the indices as 16 bit if they fit, attribute locations match
+    // the float layout so the same shaders read both
+    void setupPackedMesh()
+    {
+        buffers->positionOffset = bounds.empty() ? glm::vec3(0.0f) : bounds.min;
+        buffers->positionScale = bounds.empty() ? glm::vec3(0.0f) : bounds.max - bounds.min;
+        vector<PackedVertex> packedVertices(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            packedVertices[i] = PackedVertex::pack(vertices[i], buffers->positionOffset, buffers->positionScale);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers->VBO);
+        glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(PackedVertex), packedVertices.data(), GL_STATIC_DRAW);
 
-        glBindVertexArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->EBO);
+        if (vertices.size() <= 65536)
+        {
+            vector<uint16_t> shortIndices(indices.begin(), indices.end());
+            buffers->indexType = GL_UNSIGNED_SHORT;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        }
+
+        setVertexAttributes(true);
+
+        GLState::instance().bindVertexArray(0);
+    }
+};
+
+// draws of meshes that share their buffers and their texture set, issued with one glMultiDrawElementsBaseVertex
+// (or one instanced draw per range, GL 3.3 has no instanced multi draw). The first mesh binds the textures.
+struct MeshBatch {
+    Mesh *first = nullptr;
+    vector<GLsizei> counts;
+    vector<const void*> offsets;
+    vector<GLint> baseVertices;
+
+    void clear()
+    {
+        first = nullptr;
+        counts.clear();
+        offsets.clear();
+        baseVertices.clear();
+    }
+
+    void add(Mesh &mesh, unsigned int lod)
+    {
+        if (!first)
+            first = &mesh;
+        mesh.addRange(lod, counts, offsets, baseVertices);
+    }
+
+    void draw(Shader &shader) const
+    {
+        if (!first)
+            return;
+        first->bindMaterial(shader);
+        GLState::instance().bindVertexArray(first->VAO);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), first->sharedBuffers()->indexType, offsets.data(),
+                                      (GLsizei)counts.size(), baseVertices.data());
+        RenderStats::frame().draw(triangles());
+    }
+
+    void drawInstanced(Shader &shader, unsigned int instanceCount) const
+    {
+        if (!first)
+            return;
+        first->bindMaterial(shader);
+        GLState::instance().bindVertexArray(first->VAO);
+        for (size_t i = 0; i < counts.size(); i++)
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, counts[i], first->sharedBuffers()->indexType, offsets[i], instanceCount, baseVertices[i]);
+        RenderStats::frame().draw(triangles() * instanceCount);
+        // the ranges after the first are separate draw calls
+        RenderStats::frame().drawCalls += (unsigned int)counts.size() - 1;
+    }
+
+    // draw or drawInstanced (instanceCount > 0) for the depth pre-pass: no textures, and the position-only
+    // vertex array if the meshes have one
+    void drawDepth(unsigned int instanceCount = 0) const
+    {
+        if (!first)
+            return;
+        GLState::instance().bindVertexArray(first->depthVAO());
+        GLenum indexType = first->sharedBuffers()->indexType;
+        if (instanceCount == 0)
+        {
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), indexType, offsets.data(), (GLsizei)counts.size(), baseVertices.data());
+            RenderStats::frame().draw(triangles());
+            return;
+        }
+        for (size_t i = 0; i < counts.size(); i++)
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, counts[i], indexType, offsets[i], instanceCount, baseVertices[i]);
+        RenderStats::frame().draw(triangles() * instanceCount);
+        RenderStats::frame().drawCalls += (unsigned int)counts.size() - 1;
+    }
+
+private:
+    uint64_t triangles() const
+    {
+        uint64_t count = 0;
+        for (GLsizei indexCount : counts)
+            count += (uint64_t)indexCount / 3;
+        return count;
     }
 };
 #endif
\ No newline at end of file
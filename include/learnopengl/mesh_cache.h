@@ -0,0 +1,363 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/asset_package.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/filesystem.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+using namespace std;
+
+// a texture as referenced by a material; the GL texture itself is created when the mesh is set up.
+struct TextureReference {
+    string type;
+    string path;
+};
+
+// everything the importer produces for a single mesh, before anything is sent to the GPU.
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    vector<TextureReference> textures;
+    BoundingBox    bounds;
+    BoundingSphere boundingSphere;
+    vector<LodLevel> lods;
+};
+
+// Binary cache of already imported models, one file per model under resources/cache/models.
+// The file name is derived from the source path relative to the project root (so a package built on
+// another machine or from another checkout still matches), the import flags and the flags of the post import stages
+// that ran on the meshes (LOD generation, reordering...), the header additionally stores
+// the modification time and size of the source so that an edited model is re-imported automatically.
+// A cache file inside the open AssetPackage is used without that check, the package ships without sources.
+//
+// layout (all integers little endian, every array aligned to 8 bytes):
+//   Header, relative source path, then for each mesh:
+//   MeshHeader, bounding box and sphere, LOD ranges, texture references (u32 length + bytes for type and path),
+//   vertices, indices of all LOD levels
+class MeshCache
+{
+public:
+    static const uint32_t MAGIC   = 0x48534D53; // "SMSH"
+    static const uint32_t VERSION = 5;
+
+    // fills meshes from the cache file of the given model. Returns false on a miss or on a stale/corrupt file.
+    static bool load(const string &sourcePath, unsigned int importFlags, unsigned int pipelineFlags, vector<MeshData> &meshes)
+    {
+        string cachePath = cachePathFor(sourcePath, importFlags, pipelineFlags);
+        AssetBlob packaged;
+        if (AssetPackage::instance().find(cachePath, packaged))
+        {
+            Reader reader((const char*)packaged.data, packaged.size);
+            if (parse(reader, sourceKey(sourcePath), nullptr, importFlags, pipelineFlags, meshes))
+                return true;
+            meshes.clear();
+        }
+
+        struct stat source;
+        if (stat(sourcePath.c_str(), &source) != 0)
+            return false;
+
+        int fd = open(cachePath.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat cached;
+        if (fstat(fd, &cached) != 0 || cached.st_size < (off_t)sizeof(Header))
+        {
+            close(fd);
+            return false;
+        }
+        size_t size = (size_t)cached.st_size;
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+            return false;
+
+        Reader reader((const char*)mapping, size);
+        bool ok = parse(reader, sourceKey(sourcePath), &source, importFlags, pipelineFlags, meshes);
+        munmap(mapping, size);
+        if (!ok)
+        {
+            meshes.clear();
+            cout << "MESH_CACHE:: discarding stale cache for " << sourcePath << endl;
+        }
+        return ok;
+    }
+
+    // writes the imported meshes of a model to its cache file. The file is written to a temporary name
+    // and renamed into place, so a crash while writing never leaves a truncated cache behind.
+    static bool store(const string &sourcePath, unsigned int importFlags, unsigned int pipelineFlags, const vector<MeshData> &meshes)
+    {
+        struct stat source;
+        if (stat(sourcePath.c_str(), &source) != 0)
+            return false;
+        if (!makeDirectories(cacheDirectory()))
+            return false;
+
+        vector<char> buffer;
+        Header header;
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.importFlags = importFlags;
+        header.meshCount = (uint32_t)meshes.size();
+        header.sourceMtime = (int64_t)source.st_mtime;
+        header.sourceSize = (uint64_t)source.st_size;
+        string key = sourceKey(sourcePath);
+        header.pathLength = (uint32_t)key.size();
+        header.pipelineFlags = pipelineFlags;
+        append(buffer, &header, sizeof(header));
+        append(buffer, key.data(), key.size());
+        align(buffer);
+
+        for (const MeshData &mesh : meshes)
+        {
+            MeshHeader meshHeader;
+            meshHeader.vertexCount = (uint32_t)mesh.vertices.size();
+            meshHeader.indexCount = (uint32_t)mesh.indices.size();
+            meshHeader.textureCount = (uint32_t)mesh.textures.size();
+            meshHeader.lodCount = (uint32_t)mesh.lods.size();
+            append(buffer, &meshHeader, sizeof(meshHeader));
+            append(buffer, &mesh.bounds, sizeof(mesh.bounds));
+            append(buffer, &mesh.boundingSphere, sizeof(mesh.boundingSphere));
+            append(buffer, mesh.lods.data(), mesh.lods.size() * sizeof(LodLevel));
+            for (const TextureReference &texture : mesh.textures)
+            {
+                appendString(buffer, texture.type);
+                appendString(buffer, texture.path);
+            }
+            align(buffer);
+            append(buffer, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            align(buffer);
+            append(buffer, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+            align(buffer);
+        }
+
+        string cachePath = cachePathFor(sourcePath, importFlags, pipelineFlags);
+        string temporaryPath = cachePath + ".tmp";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (!file)
+        {
+            cout << "MESH_CACHE:: cannot write " << temporaryPath << endl;
+            return false;
+        }
+        bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        written = fclose(file) == 0 && written;
+        if (!written || rename(temporaryPath.c_str(), cachePath.c_str()) != 0)
+        {
+            remove(temporaryPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    static string cacheDirectory()
+    {
+        return FileSystem::getPath("resources/cache/models");
+    }
+
+    // one cache file per (relative source path, import flags, pipeline flags)
+    static string cachePathFor(const string &sourcePath, unsigned int importFlags, unsigned int pipelineFlags)
+    {
+        string key = sourceKey(sourcePath);
+        uint64_t hash = fnv1a(key.data(), key.size());
+        hash = fnv1a(&importFlags, sizeof(importFlags), hash);
+        hash = fnv1a(&pipelineFlags, sizeof(pipelineFlags), hash);
+        string name = key.substr(key.find_last_of('/') + 1);
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), "-%016llx.mesh", (unsigned long long)hash);
+        return cacheDirectory() + '/' + name + suffix;
+    }
+
+    // the source path as stored in and hashed into the cache file, the same spelling AssetPackage uses
+    static string sourceKey(const string &sourcePath)
+    {
+        return AssetPackage::relative(sourcePath, AssetPackage::normalize(FileSystem::getPath("")));
+    }
+
+    static uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+    {
+        const unsigned char *bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t importFlags;
+        uint32_t meshCount;
+        int64_t  sourceMtime;
+        uint64_t sourceSize;
+        uint32_t pathLength;
+        uint32_t pipelineFlags;
+    };
+
+    struct MeshHeader {
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t textureCount;
+        uint32_t lodCount;
+    };
+
+    // bounds checked cursor over the mapped file
+    struct Reader {
+        const char *data;
+        size_t size;
+        size_t offset = 0;
+
+        Reader(const char *data, size_t size) : data(data), size(size) {}
+
+        size_t remaining() const
+        {
+            return size - offset;
+        }
+        const char* take(size_t bytes)
+        {
+            if (bytes > size - offset)
+                return nullptr;
+            const char *result = data + offset;
+            offset += bytes;
+            return result;
+        }
+        bool read(void *out, size_t bytes)
+        {
+            const char *src = take(bytes);
+            if (src)
+                memcpy(out, src, bytes);
+            return src != nullptr;
+        }
+        bool readString(string &out)
+        {
+            uint32_t length;
+            if (!read(&length, sizeof(length)))
+                return false;
+            const char *src = take(length);
+            if (src)
+                out.assign(src, length);
+            return src != nullptr;
+        }
+        bool align()
+        {
+            size_t aligned = (offset + 7) & ~(size_t)7;
+            if (aligned > size)
+                return false;
+            offset = aligned;
+            return true;
+        }
+    };
+
+    // source is the state of the model file to compare with, nullptr skips the comparison
+    static bool parse(Reader &reader, const string &sourceKey, const struct stat *source,
+                      unsigned int importFlags, unsigned int pipelineFlags, vector<MeshData> &meshes)
+    {
+        Header header;
+        if (!reader.read(&header, sizeof(header)))
+            return false;
+        if (header.magic != MAGIC || header.version != VERSION || header.importFlags != importFlags
+            || header.pipelineFlags != pipelineFlags)
+            return false;
+        if (source && (header.sourceMtime != (int64_t)source->st_mtime || header.sourceSize != (uint64_t)source->st_size))
+            return false;
+        const char *path = reader.take(header.pathLength);
+        if (!path || sourceKey.compare(0, string::npos, path, header.pathLength) != 0 || !reader.align())
+            return false;
+
+        // every count is checked against the bytes left before anything is sized from it, the file may come
+        // from a package and is not trusted
+        const size_t meshSize = sizeof(MeshHeader) + sizeof(BoundingBox) + sizeof(BoundingSphere);
+        if (header.meshCount > reader.remaining() / meshSize)
+            return false;
+        meshes.resize(header.meshCount);
+        for (MeshData &mesh : meshes)
+        {
+            MeshHeader meshHeader;
+            if (!reader.read(&meshHeader, sizeof(meshHeader)) || !reader.read(&mesh.bounds, sizeof(mesh.bounds))
+                || !reader.read(&mesh.boundingSphere, sizeof(mesh.boundingSphere)))
+                return false;
+            if (meshHeader.lodCount > LodLevel::MAX_LEVELS
+                || meshHeader.textureCount > reader.remaining() / (2 * sizeof(uint32_t)))
+                return false;
+            mesh.lods.resize(meshHeader.lodCount);
+            if (meshHeader.lodCount > 0 && !reader.read(mesh.lods.data(), mesh.lods.size() * sizeof(LodLevel)))
+                return false;
+            for (const LodLevel &lod : mesh.lods)
+            {
+                if ((uint64_t)lod.indexOffset + lod.indexCount > meshHeader.indexCount)
+                    return false;
+            }
+            mesh.textures.resize(meshHeader.textureCount);
+            for (TextureReference &texture : mesh.textures)
+            {
+                if (!reader.readString(texture.type) || !reader.readString(texture.path))
+                    return false;
+            }
+            if (!reader.align())
+                return false;
+            const char *vertices = reader.take((size_t)meshHeader.vertexCount * sizeof(Vertex));
+            if (!vertices || !reader.align())
+                return false;
+            const char *indices = reader.take((size_t)meshHeader.indexCount * sizeof(unsigned int));
+            if (!indices || !reader.align())
+                return false;
+            mesh.vertices.assign((const Vertex*)vertices, (const Vertex*)vertices + meshHeader.vertexCount);
+            mesh.indices.assign((const unsigned int*)indices, (const unsigned int*)indices + meshHeader.indexCount);
+            for (unsigned int index : mesh.indices)
+            {
+                if (index >= meshHeader.vertexCount)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    static void append(vector<char> &buffer, const void *data, size_t size)
+    {
+        const char *bytes = (const char*)data;
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    static void appendString(vector<char> &buffer, const string &value)
+    {
+        uint32_t length = (uint32_t)value.size();
+        append(buffer, &length, sizeof(length));
+        append(buffer, value.data(), value.size());
+    }
+
+    static void align(vector<char> &buffer)
+    {
+        buffer.resize((buffer.size() + 7) & ~(size_t)7, 0);
+    }
+
+    static bool makeDirectories(const string &path)
+    {
+        for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+        {
+            string prefix = path.substr(0, slash);
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+            {
+                cout << "MESH_CACHE:: cannot create directory " << prefix << endl;
+                return false;
+            }
+            if (slash == string::npos)
+                return true;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,292 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <learnopengl/mesh.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Import time reordering of index and vertex buffers, run before the mesh is uploaded:
+//   optimizeVertexCache - triangle order for the post-transform vertex cache (Forsyth's linear speed algorithm)
+//   optimizeOverdraw    - splits that order into clusters and draws outward facing clusters first
+//                         (Sander et al., "Fast triangle reordering for vertex locality and reduced overdraw")
+//   optimizeVertexFetch - vertex order of first use, so the pre-transform fetches stream through memory
+class MeshOptimizer
+{
+public:
+    // size of the FIFO cache used to measure the ACMR, a typical value for desktop GPUs
+    static const unsigned int FIFO_SIZE = 16;
+
+    // average cache miss ratio: vertex shader invocations per triangle with a FIFO post-transform cache.
+    // 0.5 is the best possible for a regular grid, 3 means no reuse at all.
+    static float acmr(const unsigned int *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = FIFO_SIZE)
+    {
+        if (indexCount < 3)
+            return 0.0f;
+        std::vector<unsigned int> timestamp(vertexCount, 0);
+        unsigned int time = cacheSize + 1, misses = 0;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            if (time - timestamp[indices[i]] > cacheSize)
+            {
+                timestamp[indices[i]] = time++;
+                misses++;
+            }
+        }
+        return (float)misses / (float)(indexCount / 3);
+    }
+
+    // reorders the triangles of indices[0, indexCount) in place
+    static void optimizeVertexCache(unsigned int *indices, size_t indexCount, size_t vertexCount)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+            return;
+
+        // triangles around every vertex, the first `remaining` entries are the ones not emitted yet
+        std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0), adjacency(triangleCount * 3), remaining(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            remaining[indices[i]]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+        {
+            std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t i = 0; i < triangleCount * 3; i++)
+                adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+        }
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScore(vertexCount), triangleScore(triangleCount, 0.0f);
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScore[v] = score(-1, remaining[v]);
+        for (size_t t = 0; t < triangleCount; t++)
+            triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+        std::vector<unsigned int> output;
+        output.reserve(triangleCount * 3);
+        std::vector<char> emitted(triangleCount, 0);
+        std::vector<unsigned int> cache, nextCache;
+        cache.reserve(CACHE_SIZE + 3);
+        nextCache.reserve(CACHE_SIZE + 3);
+        size_t fallbackCursor = 0;
+        int best = -1;
+        while (output.size() < triangleCount * 3)
+        {
+            // no candidate around the cache: restart at the next triangle in input order
+            if (best < 0)
+            {
+                while (emitted[fallbackCursor])
+                    fallbackCursor++;
+                best = (int)fallbackCursor;
+            }
+            const unsigned int *triangle = &indices[best * 3];
+            output.insert(output.end(), triangle, triangle + 3);
+            emitted[best] = 1;
+
+            nextCache.assign(triangle, triangle + 3);
+            for (int corner = 0; corner < 3; corner++)
+            {
+                // drop the triangle from the vertex's pending list
+                unsigned int vertex = triangle[corner];
+                unsigned int *begin = &adjacency[adjacencyStart[vertex]], *end = begin + remaining[vertex];
+                unsigned int *found = std::find(begin, end, (unsigned int)best);
+                std::swap(*found, *(end - 1));
+                remaining[vertex]--;
+            }
+            for (unsigned int vertex : cache)
+            {
+                if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                    nextCache.push_back(vertex);
+            }
+            // vertices pushed out of the cache lose their position bonus
+            for (size_t i = CACHE_SIZE; i < nextCache.size(); i++)
+            {
+                cachePosition[nextCache[i]] = -1;
+                vertexScore[nextCache[i]] = score(-1, remaining[nextCache[i]]);
+            }
+            if (nextCache.size() > CACHE_SIZE)
+                nextCache.resize(CACHE_SIZE);
+            cache.swap(nextCache);
+
+            // rescore the cached vertices and their pending triangles, the best of those is emitted next
+            best = -1;
+            float bestScore = -1.0f;
+            for (size_t i = 0; i < cache.size(); i++)
+            {
+                cachePosition[cache[i]] = (int)i;
+                vertexScore[cache[i]] = score((int)i, remaining[cache[i]]);
+            }
+            for (unsigned int vertex : cache)
+            {
+                for (unsigned int a = adjacencyStart[vertex]; a < adjacencyStart[vertex] + remaining[vertex]; a++)
+                {
+                    unsigned int t = adjacency[a];
+                    triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                    if (triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        best = (int)t;
+                    }
+                }
+            }
+        }
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    // reorders clusters of the (vertex cache optimized) triangles of indices[0, indexCount) in place.
+    // threshold is the ACMR increase allowed for the extra cluster boundaries, 1.05 = 5% worse.
+    static void optimizeOverdraw(unsigned int *indices, size_t indexCount, const std::vector<Vertex> &vertices, float threshold = 1.05f)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2)
+            return;
+
+        // hard boundaries: triangles where the cache order had to start over, every vertex a miss
+        std::vector<unsigned int> timestamp(vertices.size(), 0);
+        unsigned int time = FIFO_SIZE + 1;
+        std::vector<size_t> hardBoundaries;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (simulate(&indices[t * 3], timestamp, time) == 3)
+                hardBoundaries.push_back(t);
+        }
+        hardBoundaries.push_back(triangleCount);
+
+        // soft boundaries: inside a hard cluster, start a new cluster whenever the part since the last boundary
+        // already has good enough locality that flushing the cache costs little
+        std::vector<size_t> clusters;
+        for (size_t h = 0; h + 1 < hardBoundaries.size(); h++)
+        {
+            size_t start = hardBoundaries[h], end = hardBoundaries[h + 1];
+            std::fill(timestamp.begin(), timestamp.end(), 0);
+            time = FIFO_SIZE + 1;
+            unsigned int misses = 0;
+            for (size_t t = start; t < end; t++)
+                misses += simulate(&indices[t * 3], timestamp, time);
+            float clusterThreshold = threshold * (float)misses / (float)(end - start);
+
+            std::fill(timestamp.begin(), timestamp.end(), 0);
+            time = FIFO_SIZE + 1;
+            clusters.push_back(start);
+            size_t clusterStart = start;
+            misses = 0;
+            for (size_t t = start; t < end; t++)
+            {
+                misses += simulate(&indices[t * 3], timestamp, time);
+                if (t + 1 < end && (float)misses / (float)(t - clusterStart + 1) <= clusterThreshold)
+                {
+                    clusters.push_back(t + 1);
+                    clusterStart = t + 1;
+                    misses = 0;
+                    std::fill(timestamp.begin(), timestamp.end(), 0);
+                    time = FIFO_SIZE + 1;
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+        size_t clusterCount = clusters.size() - 1;
+        if (clusterCount < 2)
+            return;
+
+        // area weighted centroid and normal of every cluster
+        std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f)), normals(clusterCount, glm::vec3(0.0f));
+        std::vector<float> areas(clusterCount, 0.0f);
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+            {
+                glm::vec3 p0 = vertices[indices[t * 3]].Position, p1 = vertices[indices[t * 3 + 1]].Position, p2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float area = glm::length(normal);
+                centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+                normals[c] += normal;
+                areas[c] += area;
+            }
+            meshCentroid += centroids[c];
+            meshArea += areas[c];
+            if (areas[c] > 0.0f)
+                centroids[c] /= areas[c];
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        // clusters facing away from the mesh center are in front of the others from most directions
+        std::vector<float> sortKey(clusterCount);
+        std::vector<unsigned int> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            float length = glm::length(normals[c]);
+            sortKey[c] = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+            order[c] = (unsigned int)c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&sortKey](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+        std::vector<unsigned int> output;
+        output.reserve(triangleCount * 3);
+        for (unsigned int c : order)
+            output.insert(output.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    // renumbers the vertices in order of first use by indices, unused vertices are dropped
+    static void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    {
+        std::vector<unsigned int> remap(vertices.size(), ~0u);
+        std::vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+        for (unsigned int &index : indices)
+        {
+            if (remap[index] == ~0u)
+            {
+                remap[index] = (unsigned int)reordered.size();
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(reordered);
+    }
+
+private:
+    // Forsyth's scoring parameters, CACHE_SIZE is the cache modelled while ordering
+    static const unsigned int CACHE_SIZE = 32;
+
+    static float score(int cachePosition, unsigned int remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+        float result = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // the three vertices of the last triangle get a fixed score, so the next triangle doesn't
+            // simply reuse its most recent edge
+            if (cachePosition < 3)
+                result = 0.75f;
+            else
+                result = std::pow(1.0f - (float)(cachePosition - 3) / (float)(CACHE_SIZE - 3), 1.5f);
+        }
+        // vertices with few triangles left are finished first, so they can leave the cache
+        return result + 2.0f / std::sqrt((float)remainingTriangles);
+    }
+
+    // FIFO cache misses of one triangle
+    static unsigned int simulate(const unsigned int *triangle, std::vector<unsigned int> &timestamp, unsigned int &time)
+    {
+        unsigned int misses = 0;
+        for (int corner = 0; corner < 3; corner++)
+        {
+            if (time - timestamp[triangle[corner]] > FIFO_SIZE)
+            {
+                timestamp[triangle[corner]] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+};
+
+#endif
@@ -0,0 +1,381 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <learnopengl/mesh.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Quadric error metric simplifier (Garland & Heckbert) used at import time to build the LOD chain of a mesh.
+// Edges are collapsed onto one of their existing end points, so every level is just another index list
+// over the unchanged vertex buffer of the mesh. Vertices sharing a position (UV/normal seams) are collapsed
+// together, borders may only slide along themselves and vertices on non-manifold edges never move.
+class MeshSimplifier
+{
+public:
+    // returns the indices of a simplified copy of the triangle list. Stops once at most targetIndexCount
+    // indices are left or when the next collapse would move the surface by more than maxError (model units).
+    // The largest error of the applied collapses is written to resultError.
+    static std::vector<unsigned int> simplify(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                                              size_t targetIndexCount, float maxError, float *resultError = nullptr)
+    {
+        size_t vertexCount = vertices.size();
+        std::vector<unsigned int> remap = positionRemap(vertices);
+
+        // wedges (vertices) of every position, as ranges into wedgeList
+        std::vector<unsigned int> wedgeStart(vertexCount + 1, 0), wedgeList(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            wedgeStart[remap[v] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            wedgeStart[v + 1] += wedgeStart[v];
+        {
+            std::vector<unsigned int> fill(wedgeStart.begin(), wedgeStart.end() - 1);
+            for (size_t v = 0; v < vertexCount; v++)
+                wedgeList[fill[remap[v]]++] = (unsigned int)v;
+        }
+
+        // drop triangles that are already degenerate in position
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (a != b && b != c && a != c)
+                result.insert(result.end(), indices.begin() + i, indices.begin() + i + 3);
+        }
+
+        std::vector<Edge> edges;
+        collectEdges(result, remap, edges);
+        std::vector<unsigned char> kind = classifyVertices(vertexCount, remap, edges);
+        std::vector<Quadric> quadrics = buildQuadrics(vertices, result, remap, edges);
+
+        float appliedError = 0.0f;
+        std::vector<Collapse> candidates;
+        std::vector<unsigned int> collapseTarget(vertexCount), wedgeTarget(vertexCount);
+        std::vector<unsigned char> touched(vertexCount);
+        std::vector<unsigned int> triangleStart, triangleList;
+        while (result.size() > targetIndexCount)
+        {
+            collectEdges(result, remap, edges);
+            buildAdjacency(result, remap, vertexCount, triangleStart, triangleList);
+
+            // cheapest valid direction of every edge
+            candidates.clear();
+            for (const Edge &edge : edges)
+            {
+                Collapse best;
+                best.error = -1.0f;
+                for (int direction = 0; direction < 2; direction++)
+                {
+                    unsigned int from = direction ? edge.b : edge.a, to = direction ? edge.a : edge.b;
+                    if (kind[from] == LOCKED || (kind[from] == BORDER && (edge.triangles != 1 || kind[to] != BORDER)))
+                        continue;
+                    Quadric sum = quadrics[from];
+                    sum.add(quadrics[to]);
+                    float error = sum.error(vertices[to].Position);
+                    if (best.error < 0.0f || error < best.error)
+                    {
+                        best.from = from;
+                        best.to = to;
+                        best.error = error;
+                        best.triangles = edge.triangles;
+                    }
+                }
+                if (best.error >= 0.0f && best.error <= maxError)
+                    candidates.push_back(best);
+            }
+            if (candidates.empty())
+                break;
+            std::sort(candidates.begin(), candidates.end(),
+                      [](const Collapse &x, const Collapse &y) { return x.error < y.error; });
+
+            // pick independent collapses: the one ring of a collapsed vertex is not touched again in this pass,
+            // so the flip test of every accepted collapse stays valid
+            std::fill(touched.begin(), touched.end(), 0);
+            std::fill(collapseTarget.begin(), collapseTarget.end(), ~0u);
+            size_t trianglesToRemove = (result.size() - targetIndexCount + 2) / 3, removed = 0;
+            bool collapsed = false;
+            for (const Collapse &collapse : candidates)
+            {
+                if (touched[collapse.from] || touched[collapse.to])
+                    continue;
+                if (flips(vertices, result, remap, triangleStart, triangleList, collapse.from, collapse.to))
+                    continue;
+                collapseTarget[collapse.from] = collapse.to;
+                touched[collapse.from] = touched[collapse.to] = 1;
+                for (unsigned int t = triangleStart[collapse.from]; t < triangleStart[collapse.from + 1]; t++)
+                    for (int corner = 0; corner < 3; corner++)
+                        touched[remap[result[triangleList[t] * 3 + corner]]] = 1;
+                appliedError = std::max(appliedError, collapse.error);
+                collapsed = true;
+                removed += collapse.triangles;
+                if (removed >= trianglesToRemove)
+                    break;
+            }
+            if (!collapsed)
+                break;
+
+            // every wedge of a collapsed position moves to the wedge of the target on the same side of a seam,
+            // found through a triangle that contains both. Wedges without one take the closest attributes.
+            for (size_t v = 0; v < vertexCount; v++)
+                wedgeTarget[v] = (unsigned int)v;
+            for (unsigned int from = 0; from < vertexCount; from++)
+            {
+                unsigned int to = collapseTarget[from];
+                if (to == ~0u)
+                    continue;
+                for (unsigned int t = triangleStart[from]; t < triangleStart[from + 1]; t++)
+                {
+                    const unsigned int *triangle = &result[triangleList[t] * 3];
+                    unsigned int fromWedge = ~0u, toWedge = ~0u;
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        if (remap[triangle[corner]] == from)
+                            fromWedge = triangle[corner];
+                        else if (remap[triangle[corner]] == to)
+                            toWedge = triangle[corner];
+                    }
+                    if (toWedge != ~0u && wedgeTarget[fromWedge] == fromWedge)
+                        wedgeTarget[fromWedge] = toWedge;
+                }
+                for (unsigned int w = wedgeStart[from]; w < wedgeStart[from + 1]; w++)
+                {
+                    unsigned int wedge = wedgeList[w];
+                    if (wedgeTarget[wedge] == wedge)
+                        wedgeTarget[wedge] = closestWedge(vertices, vertices[wedge], wedgeList, wedgeStart[to], wedgeStart[to + 1]);
+                }
+                quadrics[to].add(quadrics[from]);
+            }
+
+            size_t write = 0;
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                unsigned int a = wedgeTarget[result[i]], b = wedgeTarget[result[i + 1]], c = wedgeTarget[result[i + 2]];
+                if (remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c])
+                    continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        if (resultError)
+            *resultError = appliedError;
+        return result;
+    }
+
+private:
+    enum : unsigned char { MANIFOLD = 0, BORDER = 1, LOCKED = 2 };
+
+    struct Edge {
+        unsigned int a, b;      // position ids, a < b
+        unsigned int triangles; // number of triangles using the edge
+    };
+
+    struct Collapse {
+        unsigned int from = 0, to = 0;
+        float error = 0.0f;
+        unsigned int triangles = 0;
+    };
+
+    // symmetric 4x4 error quadric, the error is normalized by the total plane weight so that it is
+    // a distance in model units
+    struct Quadric {
+        double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+        double weight = 0;
+
+        void addPlane(const glm::vec3 &normal, float distance, float planeWeight)
+        {
+            double a = normal.x, b = normal.y, c = normal.z, d = distance, w = planeWeight;
+            xx += w * a * a; xy += w * a * b; xz += w * a * c; xw += w * a * d;
+            yy += w * b * b; yz += w * b * c; yw += w * b * d;
+            zz += w * c * c; zw += w * c * d; ww += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric &other)
+        {
+            xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+            yy += other.yy; yz += other.yz; yw += other.yw;
+            zz += other.zz; zw += other.zw; ww += other.ww;
+            weight += other.weight;
+        }
+
+        float error(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double value = xx * x * x + yy * y * y + zz * z * z + ww
+                         + 2.0 * (xy * x * y + xz * x * z + yz * y * z + xw * x + yw * y + zw * z);
+            return weight > 0.0 ? (float)std::sqrt(std::max(value, 0.0) / weight) : 0.0f;
+        }
+    };
+
+    // maps every vertex to the first vertex with exactly the same position
+    static std::vector<unsigned int> positionRemap(const std::vector<Vertex> &vertices)
+    {
+        std::vector<unsigned int> order(vertices.size()), remap(vertices.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = (unsigned int)i;
+        auto less = [&vertices](unsigned int a, unsigned int b) {
+            const glm::vec3 &p = vertices[a].Position, &q = vertices[b].Position;
+            if (p.x != q.x) return p.x < q.x;
+            if (p.y != q.y) return p.y < q.y;
+            if (p.z != q.z) return p.z < q.z;
+            return a < b;
+        };
+        std::sort(order.begin(), order.end(), less);
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            bool same = i > 0 && vertices[order[i]].Position.x == vertices[order[i - 1]].Position.x
+                        && vertices[order[i]].Position.y == vertices[order[i - 1]].Position.y
+                        && vertices[order[i]].Position.z == vertices[order[i - 1]].Position.z;
+            remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+        }
+        return remap;
+    }
+
+    // unique position edges of the triangle list with their triangle count
+    static void collectEdges(const std::vector<unsigned int> &triangles, const std::vector<unsigned int> &remap, std::vector<Edge> &edges)
+    {
+        std::vector<uint64_t> keys;
+        keys.reserve(triangles.size());
+        for (size_t i = 0; i < triangles.size(); i += 3)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint64_t a = remap[triangles[i + corner]], b = remap[triangles[i + (corner + 1) % 3]];
+                keys.push_back(a < b ? a << 32 | b : b << 32 | a);
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        edges.clear();
+        for (size_t i = 0; i < keys.size(); )
+        {
+            size_t j = i;
+            while (j < keys.size() && keys[j] == keys[i])
+                j++;
+            edges.push_back(Edge{(unsigned int)(keys[i] >> 32), (unsigned int)(keys[i] & 0xFFFFFFFFu), (unsigned int)(j - i)});
+            i = j;
+        }
+    }
+
+    static std::vector<unsigned char> classifyVertices(size_t vertexCount, const std::vector<unsigned int> &remap, const std::vector<Edge> &edges)
+    {
+        std::vector<unsigned char> kind(vertexCount, MANIFOLD);
+        for (const Edge &edge : edges)
+        {
+            unsigned char edgeKind = edge.triangles == 1 ? BORDER : (edge.triangles > 2 ? LOCKED : MANIFOLD);
+            kind[edge.a] = std::max(kind[edge.a], edgeKind);
+            kind[edge.b] = std::max(kind[edge.b], edgeKind);
+        }
+        return kind;
+    }
+
+    // area weighted triangle planes, plus heavily weighted planes perpendicular to border edges
+    // that keep open borders in place
+    static std::vector<Quadric> buildQuadrics(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &triangles,
+                                              const std::vector<unsigned int> &remap, const std::vector<Edge> &edges)
+    {
+        std::vector<Quadric> quadrics(vertices.size());
+        std::vector<uint64_t> borderKeys;
+        for (const Edge &edge : edges)
+            if (edge.triangles == 1)
+                borderKeys.push_back((uint64_t)edge.a << 32 | edge.b);
+        for (size_t i = 0; i < triangles.size(); i += 3)
+        {
+            unsigned int corners[3] = {remap[triangles[i]], remap[triangles[i + 1]], remap[triangles[i + 2]]};
+            glm::vec3 p0 = vertices[corners[0]].Position, p1 = vertices[corners[1]].Position, p2 = vertices[corners[2]].Position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(normal);
+            if (length <= 0.0f)
+                continue;
+            normal /= length;
+            float area = length * 0.5f;
+            for (int corner = 0; corner < 3; corner++)
+                quadrics[corners[corner]].addPlane(normal, -glm::dot(normal, p0), area);
+
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint64_t a = corners[corner], b = corners[(corner + 1) % 3];
+                if (!std::binary_search(borderKeys.begin(), borderKeys.end(), a < b ? a << 32 | b : b << 32 | a))
+                    continue;
+                glm::vec3 start = vertices[a].Position, direction = vertices[b].Position - start;
+                glm::vec3 borderNormal = glm::cross(direction, normal);
+                float borderLength = glm::length(borderNormal);
+                if (borderLength <= 0.0f)
+                    continue;
+                borderNormal /= borderLength;
+                float weight = glm::dot(direction, direction) * 10.0f;
+                quadrics[a].addPlane(borderNormal, -glm::dot(borderNormal, start), weight);
+                quadrics[b].addPlane(borderNormal, -glm::dot(borderNormal, start), weight);
+            }
+        }
+        return quadrics;
+    }
+
+    // triangles around every position, as ranges into triangleList
+    static void buildAdjacency(const std::vector<unsigned int> &triangles, const std::vector<unsigned int> &remap, size_t vertexCount,
+                               std::vector<unsigned int> &triangleStart, std::vector<unsigned int> &triangleList)
+    {
+        triangleStart.assign(vertexCount + 1, 0);
+        for (unsigned int index : triangles)
+            triangleStart[remap[index] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            triangleStart[v + 1] += triangleStart[v];
+        triangleList.resize(triangles.size());
+        std::vector<unsigned int> fill(triangleStart.begin(), triangleStart.end() - 1);
+        for (size_t i = 0; i < triangles.size(); i++)
+            triangleList[fill[remap[triangles[i]]]++] = (unsigned int)(i / 3);
+    }
+
+    // true if moving from onto to would flip or squash one of the triangles around from that survives
+    static bool flips(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &triangles, const std::vector<unsigned int> &remap,
+                      const std::vector<unsigned int> &triangleStart, const std::vector<unsigned int> &triangleList,
+                      unsigned int from, unsigned int to)
+    {
+        for (unsigned int t = triangleStart[from]; t < triangleStart[from + 1]; t++)
+        {
+            const unsigned int *triangle = &triangles[triangleList[t] * 3];
+            unsigned int corners[3] = {remap[triangle[0]], remap[triangle[1]], remap[triangle[2]]};
+            if (corners[0] == to || corners[1] == to || corners[2] == to)
+                continue;
+            glm::vec3 before[3], after[3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                before[corner] = vertices[corners[corner]].Position;
+                after[corner] = corners[corner] == from ? vertices[to].Position : before[corner];
+            }
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normalBefore, normalAfter) <= 0.25f * glm::length(normalBefore) * glm::length(normalAfter))
+                return true;
+        }
+        return false;
+    }
+
+    static unsigned int closestWedge(const std::vector<Vertex> &vertices, const Vertex &vertex, const std::vector<unsigned int> &wedgeList,
+                                     unsigned int begin, unsigned int end)
+    {
+        unsigned int best = wedgeList[begin];
+        float bestDistance = 1e30f;
+        for (unsigned int w = begin; w < end; w++)
+        {
+            const Vertex &candidate = vertices[wedgeList[w]];
+            glm::vec2 uv = candidate.TexCoords - vertex.TexCoords;
+            float distance = 1.0f - glm::dot(candidate.Normal, vertex.Normal) + glm::dot(uv, uv);
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = wedgeList[w];
+            }
+        }
+        return best;
+    }
+};
+
+#endif
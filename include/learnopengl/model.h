@@ -11,33 +11,133 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimize.h>
+#include <learnopengl/mesh_simplify.h>
+#include <learnopengl/render_queue.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/texture_loader.h>
 
+#include <array>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <set>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// camera data needed to estimate how large a model appears on screen
+struct LodView {
+    glm::vec3 eye;
+    float projectionScale; // projection[1][1], the cotangent of half the vertical field of view
 
+    LodView(const glm::vec3 &eye, const glm::mat4 &projection) : eye(eye), projectionScale(projection[1][1]) {}
+
+    // diameter of the bounding sphere on screen, as a fraction of the viewport height
+    float coverage(const BoundingSphere &sphere) const
+    {
+        float distance = glm::length(sphere.center - eye);
+        if (distance <= sphere.radius)
+            return 1e30f;
+        return sphere.radius * projectionScale / distance;
+    }
+};
+
+// a diffuse and a specular texture array whose layers all have the same size, see planTextureArrays
+struct TextureArrayPlan {
+    // images of the layers, an empty specular path is a black layer
+    vector<string> diffuseLayers, specularLayers;
+    int diffuseSize[2] = {1, 1}, specularSize[2] = {1, 1};
+};
+
+// detail level one placement of a model was last drawn at. Owned by the caller and passed to every Model::Draw
+// of that placement, so the hysteresis of Model::SelectLod holds even when a model is drawn at several places.
+struct LodState {
+    unsigned int level = 0;
+};
+
+// everything a model reads from disk before it needs the GL context: the meshes from the cache or the importer,
+// and the layout of its texture arrays. Streamed models fill it on a worker thread, see ModelLoader.
+struct ModelData {
+    vector<MeshData> meshes;
+    // texture array pair and layer in it of every mesh, -1 for the meshes keeping their own textures
+    vector<int> arrays, layers;
+    vector<TextureArrayPlan> textureArrays;
+};
 
 class Model
 {
 public:
     // model data
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// every TextureCache reference taken by the meshes, released by the destructor
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // bounds of all meshes in model space
+    BoundingBox    bounds;
+    BoundingSphere boundingSphere;
+    // number of detail levels of the most detailed mesh
+    unsigned int lodCount = 1;
+    // drawn without back face culling, for open geometry like the flat tie fighter wings
+    bool twoSided = false;
+
+    // assimp post processing applied on import, part of the mesh cache key
+    static const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    // stages run on the imported meshes before they are cached, also part of the mesh cache key
+    static const unsigned int GENERATE_LODS = 1 << 0;  // simplified levels of detail, see generateLods
+    static const unsigned int OPTIMIZE_ORDER = 1 << 1; // vertex cache, overdraw and vertex fetch order, see optimizeOrder
+    static const unsigned int PACK_VERTICES = 1 << 2;  // PackedVertex layout on the GPU, applied at upload and not cached
+    static const unsigned int TEXTURE_ARRAYS = 1 << 3; // small maps in shared texture arrays, see loadTextureArrays; needs PACK_VERTICES
+    static const unsigned int POSITION_STREAM = 1 << 4; // position-only copy of the vertices for the depth pre-pass, not cached
+    static const unsigned int CACHED_STAGES = GENERATE_LODS | OPTIMIZE_ORDER;
+    static const unsigned int DEFAULT_PIPELINE = GENERATE_LODS | OPTIMIZE_ORDER | PACK_VERTICES | TEXTURE_ARRAYS | POSITION_STREAM;
+
+    // maps larger than this in either direction keep their own 2D texture
+    static const int MAX_LAYER_SIZE = 512;
+
+    // constructor, expects a filepath to a 3D model. Loads it before returning, ModelLoader::request loads
+    // models in the background instead.
+    Model(string const &path, bool gamma = false, unsigned int pipeline = DEFAULT_PIPELINE) : gammaCorrection(gamma), path(path), pipeline(pipeline)
+    {
+        directory = path.substr(0, path.find_last_of('/'));
+        ModelData data;
+        readModel(path, data);
+        uploadModel(data);
+    }
+
+    // the texture references are owned, so a model can't be copied
+    Model(const Model &) = delete;
+    Model& operator=(const Model &) = delete;
+
+    ~Model()
+    {
+        for (const Texture &texture : textures_loaded)
+            TextureCache::instance().release(texture.id);
+        for (unsigned int textureID : arrayTextureIds)
+            TextureLoader::instance().deleteTexture(textureID);
+    }
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // false while a streamed model is still loading, it draws nothing until then
+    bool Ready() const
     {
-        loadModel(path);
+        return ready;
+    }
+
+    // bytes of vertex and index data of all meshes in GPU memory
+    size_t GpuBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mesh &mesh : meshes)
+            bytes += mesh.gpuBytes();
+        return bytes;
     }
 
     // draws the model, and thus all its meshes
@@ -47,33 +147,431 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // true if the model placed with the given model matrix may be visible, check before setting any uniforms
+    bool IsVisible(const Frustum &frustum, const glm::mat4 &model) const
+    {
+        return frustum.intersects(boundingSphere.transformed(model));
+    }
+
+    // submits the meshes whose bounds intersect the frustum, at the detail level matching the size of the model
+    // on screen; lod is the level this placement had last frame and is updated. The queue sets model as the
+    // modelLocation uniform before each draw. Returns the number of meshes submitted.
+    unsigned int Draw(RenderQueue &queue, Shader &shader, GLint modelLocation, const Frustum &frustum, const LodView &view,
+                      const glm::mat4 &model, LodState &lod)
+    {
+        if (!ready || !IsVisible(frustum, model))
+            return 0;
+        lod.level = SelectLod(view.coverage(boundingSphere.transformed(model)), lod.level);
+        unsigned int submitted = 0;
+        for (const vector<unsigned int> &group : materialGroups)
+        {
+            RenderCommand *command = nullptr;
+            float distance = 1e30f;
+            for (unsigned int i : group)
+            {
+                // the sphere rejects most meshes cheaply, the box is tighter for long thin parts
+                BoundingSphere sphere = meshes[i].boundingSphere.transformed(model);
+                if (!frustum.intersects(sphere) || !frustum.intersects(meshes[i].bounds, model))
+                    continue;
+                if (!command)
+                    command = &queue.submit();
+                command->batch.add(meshes[i], lod.level);
+                distance = std::min(distance, glm::length(sphere.center - view.eye));
+                submitted++;
+            }
+            if (!command)
+                continue;
+            unsigned int material = queue.materialId(meshes[group[0]].textures);
+            command->key = RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, twoSided, queue.programId(shader), material, distance);
+            command->shader = &shader;
+            command->twoSided = twoSided;
+            command->modelLocation = modelLocation;
+            command->model = model;
+        }
+        return submitted;
+    }
+
+    // draws count copies of the model with one instanced draw call per mesh. The shader reads the model
+    // matrix from attribute 5 (see scene_light_instanced.vs) instead of the model uniform.
+    void DrawInstanced(Shader &shader, const glm::mat4 *models, unsigned int count)
+    {
+        if (count == 0)
+            return;
+        uploadInstances(models, count);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            meshes[i].setupInstanceAttributes(instanceVBO, 0);
+            meshes[i].DrawInstanced(shader, count);
+        }
+    }
+
+    void DrawInstanced(Shader &shader, const vector<glm::mat4> &models)
+    {
+        DrawInstanced(shader, models.data(), (unsigned int)models.size());
+    }
+
+    // as above, but only the instances whose bounding sphere intersects the frustum are drawn, and the draws
+    // are submitted to the queue. Every instance picks its own detail level, the instances are grouped by level
+    // into consecutive ranges of the queue's instance buffer and each level is one instanced draw per mesh.
+    // Instances keep their level between frames, so models must stay in the same order.
+    // Returns the number of visible instances.
+    unsigned int DrawInstanced(RenderQueue &queue, Shader &shader, const vector<glm::mat4> &models, const Frustum &frustum,
+                               const LodView &view)
+    {
+        if (!ready)
+            return 0;
+        instanceLods.resize(models.size(), 0);
+        visibleLevels.resize(models.size());
+        unsigned int levelCounts[MAX_LODS] = {};
+        // distance of the nearest instance of every level, the sort key of its draws
+        float levelDistance[MAX_LODS];
+        std::fill(levelDistance, levelDistance + MAX_LODS, 1e30f);
+        unsigned int visible = 0;
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            BoundingSphere sphere = boundingSphere.transformed(models[i]);
+            if (!frustum.intersects(sphere))
+            {
+                visibleLevels[i] = NOT_VISIBLE;
+                continue;
+            }
+            instanceLods[i] = (unsigned char)SelectLod(view.coverage(sphere), instanceLods[i]);
+            visibleLevels[i] = instanceLods[i];
+            levelCounts[instanceLods[i]]++;
+            levelDistance[instanceLods[i]] = std::min(levelDistance[instanceLods[i]], glm::length(sphere.center - view.eye));
+            visible++;
+        }
+        if (visible == 0)
+            return 0;
+
+        // counting sort of the visible instances by level
+        unsigned int levelStart[MAX_LODS + 1] = {};
+        for (unsigned int level = 0; level < MAX_LODS; level++)
+            levelStart[level + 1] = levelStart[level] + levelCounts[level];
+        visibleInstances.resize(visible);
+        unsigned int fill[MAX_LODS];
+        std::copy(levelStart, levelStart + MAX_LODS, fill);
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            if (visibleLevels[i] != NOT_VISIBLE)
+                visibleInstances[fill[visibleLevels[i]]++] = models[i];
+        }
+
+        // the queue uploads the matrices when it executes, so every submission keeps its own range
+        size_t firstInstance = queue.addInstances(visibleInstances.data(), visible);
+        for (unsigned int level = 0; level < MAX_LODS; level++)
+        {
+            if (levelCounts[level] == 0)
+                continue;
+            for (const vector<unsigned int> &group : materialGroups)
+            {
+                RenderCommand &command = queue.submit();
+                for (unsigned int i : group)
+                    command.batch.add(meshes[i], level);
+                command.key = RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, twoSided, queue.programId(shader),
+                                                   queue.materialId(meshes[group[0]].textures), levelDistance[level]);
+                command.shader = &shader;
+                command.twoSided = twoSided;
+                command.instanceCount = levelCounts[level];
+                // no base instance in GL 3.3, so each level points the instance attributes at its range
+                command.instanceOffset = firstInstance + levelStart[level] * sizeof(glm::mat4);
+            }
+        }
+        return visible;
+    }
+
+    // detail level for a model covering the given fraction of the viewport height. A level only changes once
+    // the coverage is clearly past its threshold, so models close to one don't flicker between levels.
+    unsigned int SelectLod(float coverage, unsigned int current) const
+    {
+        // coverage below which level i + 1 is used instead of level i
+        static const float thresholds[MAX_LODS - 1] = {0.25f, 0.12f, 0.05f};
+        static const float hysteresis = 0.15f;
+        unsigned int level = 0;
+        while (level + 1 < lodCount)
+        {
+            float threshold = thresholds[level] * (current > level ? 1.0f + hysteresis : 1.0f - hysteresis);
+            if (coverage >= threshold)
+                break;
+            level++;
+        }
+        return level;
+    }
+
+    // also applies to the meshes of a streamed model that is still loading
     void SetShaderTextureNamePrefix(std::string prefix) {
+        textureNamePrefix = prefix;
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
+            mesh.resetSamplerLocations();
         }
     }
 private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+    friend class ModelLoader;
+
+    // the file the model was loaded from
+    string path;
+    unsigned int pipeline;
+    bool ready = false;
+    std::string textureNamePrefix;
+
+    // texture arrays built by loadTextureArrays, not shared with other models
+    vector<unsigned int> arrayTextureIds;
+    // indices of the meshes sharing a texture set, each group is one (multi) draw
+    vector<vector<unsigned int>> materialGroups;
+    // per-instance model matrices shared by all meshes of the model, for the immediate DrawInstanced
+    unsigned int instanceVBO = 0;
+    unsigned int instanceCapacity = 0;
+    // model matrices of the instances that passed frustum culling this frame, sorted by level
+    vector<glm::mat4> visibleInstances;
+    // detail level of every instance, and the level of the visible ones this frame
+    vector<unsigned char> instanceLods;
+    vector<unsigned char> visibleLevels;
+
+    static const unsigned int MAX_LODS = LodLevel::MAX_LEVELS;
+    static const unsigned char NOT_VISIBLE = 0xFF;
+
+    // an empty model for ModelLoader, which fills it with readModel on a worker and uploadModel on the GL thread
+    struct Streamed {};
+    Model(string const &path, bool gamma, unsigned int pipeline, Streamed) : gammaCorrection(gamma), path(path), pipeline(pipeline)
+    {
+        directory = path.substr(0, path.find_last_of('/'));
+    }
+
+    void uploadInstances(const glm::mat4 *models, unsigned int count)
+    {
+        if (instanceVBO == 0)
+            glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (count > instanceCapacity)
+        {
+            instanceCapacity = count;
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), models, GL_STREAM_DRAW);
+        }
+        else
+        {
+            // orphan the old storage so we don't wait for draws of the previous frame still reading it
+            glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), models);
+        }
+    }
+
+    // reads the meshes from the mesh cache, or with supported ASSIMP extensions from file on a cache miss, and
+    // plans the texture arrays. Touches neither GL nor the model's members, so it can run on any thread.
+    // reimport skips the mesh cache, for a file that changed since it was cached.
+    void readModel(string const &path, ModelData &data, bool reimport = false) const
+    {
+        vector<MeshData> &imported = data.meshes;
+        if (reimport || !MeshCache::load(path, importFlags, pipeline & CACHED_STAGES, imported))
+        {
+            if (!importModel(path, imported))
+                return;
+            if (pipeline & GENERATE_LODS)
+            {
+                for (MeshData &mesh : imported)
+                    generateLods(mesh);
+            }
+            if (pipeline & OPTIMIZE_ORDER)
+                optimizeOrder(path, imported);
+            MeshCache::store(path, importFlags, pipeline & CACHED_STAGES, imported);
+        }
+        data.arrays.assign(imported.size(), -1);
+        data.layers.assign(imported.size(), -1);
+        if ((pipeline & TEXTURE_ARRAYS) && (pipeline & PACK_VERTICES))
+            planTextureArrays(data);
+    }
+
+    // creates the textures and the meshes of the data readModel returned and uploads the geometry, GL thread only
+    void uploadModel(ModelData &data)
+    {
+        vector<MeshData> &imported = data.meshes;
+        vector<vector<Texture>> arrayTextures;
+        if (!data.textureArrays.empty())
+            arrayTextures = loadTextureArrays(data);
+
+        meshes.reserve(imported.size());
+        // texture names of a material -> its group
+        std::map<vector<unsigned int>, unsigned int> groupOfMaterial;
+        for (size_t i = 0; i < imported.size(); i++)
+        {
+            MeshData &source = imported[i];
+            vector<Texture> textures = data.arrays[i] >= 0 ? arrayTextures[data.arrays[i]] : loadMaterialTextures(source.textures);
+            meshes.push_back(Mesh(std::move(source.vertices), std::move(source.indices), std::move(textures),
+                                  source.bounds, source.boundingSphere, std::move(source.lods), (pipeline & PACK_VERTICES) != 0, false));
+            Mesh &mesh = meshes.back();
+            mesh.textureLayer = data.layers[i];
+            mesh.glslIdentifierPrefix = textureNamePrefix;
+            lodCount = std::max(lodCount, (unsigned int)mesh.lods.size());
+            vector<unsigned int> names;
+            for (const Texture &texture : mesh.textures)
+                names.push_back(texture.id);
+            std::map<vector<unsigned int>, unsigned int>::iterator group = groupOfMaterial.emplace(names, (unsigned int)materialGroups.size()).first;
+            if (group->second == materialGroups.size())
+                materialGroups.emplace_back();
+            materialGroups[group->second].push_back((unsigned int)meshes.size() - 1);
+        }
+
+        vector<BoundingSphere> spheres;
+        for (const Mesh &mesh : meshes)
+        {
+            bounds.expand(mesh.bounds);
+            spheres.push_back(mesh.boundingSphere);
+        }
+        boundingSphere = BoundingSphere::around(bounds, spheres);
+        uploadMeshes();
+        ready = true;
+    }
+
+    // exchanges what uploadModel created with another model of the same file, so a model loaded again replaces
+    // this one's contents in place. The instance buffer stays, the new vertex arrays pick it up on their first
+    // instanced draw.
+    void swapContents(Model &other)
+    {
+        std::swap(textures_loaded, other.textures_loaded);
+        std::swap(meshes, other.meshes);
+        std::swap(bounds, other.bounds);
+        std::swap(boundingSphere, other.boundingSphere);
+        std::swap(lodCount, other.lodCount);
+        std::swap(arrayTextureIds, other.arrayTextureIds);
+        std::swap(materialGroups, other.materialGroups);
+        std::swap(ready, other.ready);
+        instanceLods.clear();
+    }
+
+    // deletes the vertex arrays and buffers of the meshes; the model must not be drawn anymore
+    void releaseGeometry()
+    {
+        std::set<MeshBuffers*> released;
+        for (Mesh &mesh : meshes)
+        {
+            MeshBuffers *buffers = mesh.sharedBuffers().get();
+            if (!buffers || !released.insert(buffers).second || buffers->VAO == 0)
+                continue;
+            GLState::instance().deleteVertexArray(buffers->VAO);
+            glDeleteBuffers(1, &buffers->VBO);
+            glDeleteBuffers(1, &buffers->EBO);
+            if (buffers->depthVAO)
+            {
+                GLState::instance().deleteVertexArray(buffers->depthVAO);
+                glDeleteBuffers(1, &buffers->positionVBO);
+            }
+        }
+        meshes.clear();
+        materialGroups.clear();
+        ready = false;
+    }
+
+    // puts the vertices of all meshes into one buffer and their indices into another, so the meshes of a
+    // material group can be drawn with one glMultiDrawElementsBaseVertex without switching vertex arrays.
+    // Packed positions are quantized within the model bounds. Indices stay relative to the base vertex of
+    // their mesh, so the packed layout keeps 16 bit indices as long as no single mesh exceeds 65536 vertices.
+    // With POSITION_STREAM the positions are also put into a buffer of their own, in the same format, for the
+    // depth pre-pass: it fetches 8 (packed) or 12 bytes per vertex instead of the whole vertex.
+    void uploadMeshes()
+    {
+        if (meshes.empty())
+            return;
+        std::shared_ptr<MeshBuffers> buffers = std::make_shared<MeshBuffers>();
+        glGenVertexArrays(1, &buffers->VAO);
+        glGenBuffers(1, &buffers->VBO);
+        glGenBuffers(1, &buffers->EBO);
+        buffers->packed = (pipeline & PACK_VERTICES) != 0;
+        size_t vertexCount = 0, indexCount = 0, largestMesh = 0;
+        for (const Mesh &mesh : meshes)
+        {
+            vertexCount += mesh.vertices.size();
+            indexCount += mesh.indices.size();
+            largestMesh = std::max(largestMesh, mesh.vertices.size());
+        }
+        if (buffers->packed)
+        {
+            buffers->indexType = largestMesh <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            buffers->positionOffset = bounds.empty() ? glm::vec3(0.0f) : bounds.min;
+            buffers->positionScale = bounds.empty() ? glm::vec3(0.0f) : bounds.max - bounds.min;
+        }
+
+        size_t vertexSize = buffers->packed ? sizeof(PackedVertex) : sizeof(Vertex);
+        size_t positionSize = buffers->positionSize();
+        bool positionStream = (pipeline & POSITION_STREAM) != 0;
+        vector<unsigned char> vertexData(vertexCount * vertexSize), indexData(indexCount * buffers->indexSize());
+        vector<unsigned char> positionData(positionStream ? vertexCount * positionSize : 0);
+        size_t baseVertex = 0, firstIndex = 0;
+        for (Mesh &mesh : meshes)
+        {
+            unsigned char *vertexOut = vertexData.data() + baseVertex * vertexSize;
+            unsigned char *positionOut = positionStream ? positionData.data() + baseVertex * positionSize : nullptr;
+            for (size_t i = 0; i < mesh.vertices.size(); i++)
+            {
+                if (buffers->packed)
+                {
+                    PackedVertex packed = PackedVertex::pack(mesh.vertices[i], buffers->positionOffset, buffers->positionScale,
+                                                             (unsigned int)std::max(mesh.textureLayer, 0));
+                    std::memcpy(vertexOut + i * vertexSize, &packed, vertexSize);
+                    if (positionStream)
+                        std::memcpy(positionOut + i * positionSize, packed.position, positionSize);
+                }
+                else
+                {
+                    std::memcpy(vertexOut + i * vertexSize, &mesh.vertices[i], vertexSize);
+                    if (positionStream)
+                        std::memcpy(positionOut + i * positionSize, &mesh.vertices[i].Position, positionSize);
+                }
+            }
+            for (size_t i = 0; i < mesh.indices.size(); i++)
+            {
+                if (buffers->indexType == GL_UNSIGNED_SHORT)
+                    ((uint16_t*)indexData.data())[firstIndex + i] = (uint16_t)mesh.indices[i];
+                else
+                    ((unsigned int*)indexData.data())[firstIndex + i] = mesh.indices[i];
+            }
+            mesh.setBuffers(buffers, (int)baseVertex, (unsigned int)firstIndex);
+            baseVertex += mesh.vertices.size();
+            firstIndex += mesh.indices.size();
+        }
+
+        GLState::instance().bindVertexArray(buffers->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers->VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size(), indexData.data(), GL_STATIC_DRAW);
+        Mesh::setVertexAttributes(buffers->packed);
+        if (positionStream)
+        {
+            glGenVertexArrays(1, &buffers->depthVAO);
+            glGenBuffers(1, &buffers->positionVBO);
+            GLState::instance().bindVertexArray(buffers->depthVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, buffers->positionVBO);
+            glBufferData(GL_ARRAY_BUFFER, positionData.size(), positionData.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->EBO);
+            // attribute 0 as in setVertexAttributes, tightly packed
+            glEnableVertexAttribArray(0);
+            if (buffers->packed)
+                glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, (GLsizei)positionSize, (void*)0);
+            else
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (GLsizei)positionSize, (void*)0);
+        }
+        GLState::instance().bindVertexArray(0);
+    }
+
+    // read file via ASSIMP and convert it into plain mesh data
+    bool importModel(string const &path, vector<MeshData> &imported) const
     {
-        // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, importFlags);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, imported);
+        return true;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    void processNode(aiNode *node, const aiScene *scene, vector<MeshData> &imported) const
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -81,22 +579,24 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            imported.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, imported);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene) const
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -140,9 +640,11 @@ private:
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
 
             vertices.push_back(vertex);
-
-
+            data.bounds.expand(vertex.Position);
         }
+        // bounding sphere around the box center, tighter than the box diagonal for most shapes
+        if (!vertices.empty())
+            data.boundingSphere = BoundingSphere::around(data.bounds, &vertices[0].Position, vertices.size(), sizeof(Vertex));
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
@@ -159,101 +661,240 @@ private:
         // diffuse: texture_diffuseN
         // specular: texture_specularN
         // normal: texture_normalN
-        aiColor3D color(0.0f, 0.0f, 0.0f);
-        material->Get(AI_MATKEY_COLOR_AMBIENT, color);
-
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data.textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data.textures);
 
+        return data;
+    }
 
+    // appends up to MAX_LODS - 1 simplified index ranges, each with about half the triangles of the one
+    // before, built from the previous level so the chain stays consistent
+    void generateLods(MeshData &data) const
+    {
+        data.lods.assign(1, LodLevel{0, (unsigned int)data.indices.size(), 0.0f});
+        // small meshes cost less than the extra draw ranges are worth
+        if (data.indices.size() < 3 * 256)
+            return;
+        vector<unsigned int> previous = data.indices;
+        while (data.lods.size() < MAX_LODS)
+        {
+            // level n may deviate from the full mesh by up to 2n percent of the mesh size
+            float maxError = data.boundingSphere.radius * 0.02f * data.lods.size() - data.lods.back().error;
+            float error = 0.0f;
+            vector<unsigned int> simplified = MeshSimplifier::simplify(data.vertices, previous, previous.size() / 6 * 3, maxError, &error);
+            // stop once simplification stalls on locked borders or the error limit
+            if (simplified.empty() || simplified.size() > previous.size() * 4 / 5)
+                break;
+            data.lods.push_back(LodLevel{(unsigned int)data.indices.size(), (unsigned int)simplified.size(),
+                                         data.lods.back().error + error});
+            data.indices.insert(data.indices.end(), simplified.begin(), simplified.end());
+            previous.swap(simplified);
+        }
+    }
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+    // reorders the triangles of every LOD range for the post-transform cache and for overdraw, then the vertices
+    // for fetch locality. Prints the ACMR of the full detail meshes before and after.
+    void optimizeOrder(string const &path, vector<MeshData> &imported) const
+    {
+        size_t triangles = 0;
+        double missesBefore = 0.0, missesAfter = 0.0;
+        for (MeshData &data : imported)
+        {
+            if (data.indices.empty())
+                continue;
+            if (data.lods.empty())
+                data.lods.assign(1, LodLevel{0, (unsigned int)data.indices.size(), 0.0f});
+            const LodLevel &full = data.lods[0];
+            missesBefore += MeshOptimizer::acmr(&data.indices[full.indexOffset], full.indexCount, data.vertices.size()) * (full.indexCount / 3);
+            for (const LodLevel &lod : data.lods)
+            {
+                MeshOptimizer::optimizeVertexCache(&data.indices[lod.indexOffset], lod.indexCount, data.vertices.size());
+                MeshOptimizer::optimizeOverdraw(&data.indices[lod.indexOffset], lod.indexCount, data.vertices);
+            }
+            MeshOptimizer::optimizeVertexFetch(data.vertices, data.indices);
+            missesAfter += MeshOptimizer::acmr(&data.indices[full.indexOffset], full.indexCount, data.vertices.size()) * (full.indexCount / 3);
+            triangles += full.indexCount / 3;
+        }
+        if (triangles > 0)
+            cout << "MESH_OPTIMIZE:: " << path << " ACMR " << missesBefore / triangles << " -> " << missesAfter / triangles << endl;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // records the file names of all material textures of a given type
+    void collectMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, vector<TextureReference> &textures) const
     {
-        vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            textures.push_back(TextureReference{typeName, str.C_Str()});
+        }
+    }
+
+    // models made of many parts with a small texture each would rebind textures for nearly every part. Instead,
+    // the meshes whose only maps are a diffuse and optionally a specular map of at most MAX_LAYER_SIZE pixels
+    // per side draw from a diffuse and a specular texture array, with a layer per distinct pair of maps, and
+    // thus form one material group per array pair. Pairs are grouped into arrays by the sizes of their maps,
+    // so layers are stored at their own size and texture coordinates stay as they are. A missing specular map
+    // is a black layer. An array holds at most PackedVertex::MAX_LAYERS layers, the layer index has to fit next
+    // to the handedness bit; loadTextureArrays further limits it to what the driver supports.
+    // Fills in the array and layer of every mesh, -1 for the meshes that keep their own textures, and the layer
+    // images. Only reads image headers, loadTextureArrays creates the arrays.
+    void planTextureArrays(ModelData &data) const
+    {
+        const vector<MeshData> &imported = data.meshes;
+        // (diffuse size, specular size or 0x0 without a specular map) -> array, (diffuse, specular) -> layer
+        std::map<std::array<int, 4>, int> arrayOfSizes;
+        std::map<std::pair<string, string>, int> layerOfMaps;
+        vector<TextureArrayPlan> &plans = data.textureArrays;
+        for (size_t i = 0; i < imported.size(); i++)
+        {
+            string diffuse, specular;
+            bool fits = true;
+            for (const TextureReference &reference : imported[i].textures)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                string &slot = reference.type == "texture_diffuse" ? diffuse : specular;
+                if ((reference.type != "texture_diffuse" && reference.type != "texture_specular") || !slot.empty())
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+                    fits = false;
                     break;
                 }
+                slot = directory + '/' + reference.path;
+            }
+            int diffuseSize[2] = {0, 0}, specularSize[2] = {0, 0};
+            if (!fits || diffuse.empty() || !imageSize(diffuse, diffuseSize)
+                || (!specular.empty() && !imageSize(specular, specularSize)))
+                continue;
+            if (std::max(std::max(diffuseSize[0], diffuseSize[1]), std::max(specularSize[0], specularSize[1])) > MAX_LAYER_SIZE)
+                continue;
+            std::pair<string, string> maps(diffuse, specular);
+            std::map<std::pair<string, string>, int>::iterator known = layerOfMaps.find(maps);
+            std::array<int, 4> sizes = {{diffuseSize[0], diffuseSize[1], specularSize[0], specularSize[1]}};
+            std::map<std::array<int, 4>, int>::iterator array = arrayOfSizes.emplace(sizes, (int)plans.size()).first;
+            if (array->second == (int)plans.size())
+            {
+                plans.emplace_back();
+                TextureArrayPlan &plan = plans.back();
+                for (int axis = 0; axis < 2; axis++)
+                {
+                    plan.diffuseSize[axis] = diffuseSize[axis];
+                    plan.specularSize[axis] = std::max(specularSize[axis], 1);
+                }
+            }
+            TextureArrayPlan &plan = plans[array->second];
+            if (known == layerOfMaps.end())
+            {
+                if (plan.diffuseLayers.size() >= PackedVertex::MAX_LAYERS)
+                    continue;
+                known = layerOfMaps.emplace(maps, (int)plan.diffuseLayers.size()).first;
+                plan.diffuseLayers.push_back(diffuse);
+                plan.specularLayers.push_back(specular);
+            }
+            data.arrays[i] = array->second;
+            data.layers[i] = known->second;
+        }
+        // a single pair of maps gains nothing from an array
+        vector<int> renumbered(plans.size(), -1);
+        vector<TextureArrayPlan> kept;
+        for (size_t array = 0; array < plans.size(); array++)
+        {
+            if (plans[array].diffuseLayers.size() < 2)
+                continue;
+            renumbered[array] = (int)kept.size();
+            kept.push_back(std::move(plans[array]));
+        }
+        plans.swap(kept);
+        for (size_t i = 0; i < imported.size(); i++)
+        {
+            if (data.arrays[i] >= 0)
+                data.arrays[i] = renumbered[data.arrays[i]];
+            if (data.arrays[i] < 0)
+                data.layers[i] = -1;
+        }
+    }
+
+    // the diffuse and specular arrays planned by planTextureArrays. Layers past GL_MAX_ARRAY_TEXTURE_LAYERS
+    // are not created, their meshes fall back to their own 2D textures.
+    vector<vector<Texture>> loadTextureArrays(ModelData &data)
+    {
+        GLint maxLayers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        for (size_t i = 0; i < data.meshes.size(); i++)
+        {
+            if (data.layers[i] >= maxLayers)
+            {
+                data.arrays[i] = -1;
+                data.layers[i] = -1;
             }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        }
+
+        vector<vector<Texture>> arrays;
+        for (TextureArrayPlan &plan : data.textureArrays)
+        {
+            if (plan.diffuseLayers.size() > (size_t)maxLayers)
+            {
+                plan.diffuseLayers.resize(maxLayers);
+                plan.specularLayers.resize(maxLayers);
             }
+            Texture diffuseArray;
+            diffuseArray.id = TextureLoader::instance().loadArray(plan.diffuseLayers, plan.diffuseSize[0], plan.diffuseSize[1], gammaCorrection);
+            diffuseArray.type = "texture_diffuse_array";
+            diffuseArray.target = GL_TEXTURE_2D_ARRAY;
+            Texture specularArray;
+            specularArray.id = TextureLoader::instance().loadArray(plan.specularLayers, plan.specularSize[0], plan.specularSize[1]);
+            specularArray.type = "texture_specular_array";
+            specularArray.target = GL_TEXTURE_2D_ARRAY;
+            arrayTextureIds.push_back(diffuseArray.id);
+            arrayTextureIds.push_back(specularArray.id);
+            arrays.push_back({diffuseArray, specularArray});
+            cout << "MODEL:: " << directory << " " << plan.diffuseLayers.size() << " map pairs in " << plan.diffuseSize[0] << "x"
+                 << plan.diffuseSize[1] << " texture array layers" << endl;
+        }
+        return arrays;
+    }
+
+    // reads the image header from the asset package or the file
+    static bool imageSize(const string &path, int size[2])
+    {
+        int components;
+        AssetBlob packaged;
+        if (AssetPackage::instance().find(path, packaged))
+            return stbi_info_from_memory(packaged.data, (int)packaged.size, &size[0], &size[1], &components) != 0;
+        return stbi_info(path.c_str(), &size[0], &size[1], &components) != 0;
+    }
+
+    // takes a TextureCache reference on each referenced material texture, which loads it unless this or
+    // another model already did. The required info is returned as a Texture struct.
+    vector<Texture> loadMaterialTextures(const vector<TextureReference> &references)
+    {
+        vector<Texture> textures;
+        for(const TextureReference &reference : references)
+        {
+            Texture texture;
+            texture.id = TextureFromFile(reference.path.c_str(), this->directory);
+            texture.type = reference.type;
+            texture.path = reference.path;
+            textures.push_back(texture);
+            textures_loaded.push_back(texture);
         }
         return textures;
     }
 };
 
 
+// takes a TextureCache reference on the texture, the caller releases it with TextureCache::release. The
+// returned name is valid right away and shows a placeholder until the image has been decoded and uploaded.
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureCache::instance().acquire(filename, gamma);
 }
 #endif
@@ -0,0 +1,178 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <learnopengl/model.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/texture_loader.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Streams models in the background, the model counterpart of TextureLoader. request() returns the handle of an
+// empty model right away, the shared ThreadPool reads it (mesh cache or assimp import, LODs, vertex order,
+// texture array layout) and processUploads() creates its textures and buffers on the GL thread. Until then
+// Model::Ready() is false and the model draws nothing, so the frames before it only lack the model; its
+// textures then show TextureLoader's placeholders until they are decoded.
+// A model whose handles were all dropped while it was loading is discarded instead of uploaded.
+// reload() reads a loaded model again the same way and swaps the new contents in when they are uploaded, the
+// handles keep pointing at the same Model and it keeps drawing the old contents until then.
+class ModelLoader
+{
+public:
+    static ModelLoader& instance()
+    {
+        static ModelLoader loader;
+        return loader;
+    }
+
+    // handle of the model at path, settings like Model::SetShaderTextureNamePrefix can be made right away
+    std::shared_ptr<Model> request(const std::string &path, bool gamma = false, unsigned int pipeline = Model::DEFAULT_PIPELINE)
+    {
+        std::shared_ptr<Model> model(new Model(path, gamma, pipeline, Model::Streamed()));
+        read(model, false, false);
+        return model;
+    }
+
+    // loads a model that is ready again, from its file instead of the mesh cache with reimport. Ignored while
+    // the model is still loading.
+    void reload(const std::shared_ptr<Model> &model, bool reimport = false)
+    {
+        if (!model->Ready() || std::find(loading.begin(), loading.end(), model) != loading.end())
+            return;
+        read(model, true, reimport);
+    }
+
+    // uploads the models read since the last call, must be called on the GL thread. Stops after budgetMs
+    // milliseconds (0 = no limit), at least one model is uploaded per call. Returns the number of uploads.
+    unsigned int processUploads(float budgetMs = 4.0f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        unsigned int uploaded = 0;
+        while (true)
+        {
+            Job job;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (completed.empty())
+                    break;
+                job = std::move(completed.front());
+                completed.pop_front();
+            }
+            std::vector<std::shared_ptr<Model>>::iterator model = std::find_if(loading.begin(), loading.end(),
+                [&job](const std::shared_ptr<Model> &candidate) { return candidate.get() == job.model; });
+            // only the loader still holds it, nobody would draw it
+            if (model->use_count() > 1 && !job.reload)
+            {
+                (*model)->uploadModel(job.data);
+                uploaded++;
+            }
+            else if (model->use_count() > 1 && !job.data.meshes.empty())
+            {
+                Model &target = **model;
+                Model fresh(target.path, target.gammaCorrection, target.pipeline, Model::Streamed());
+                fresh.textureNamePrefix = target.textureNamePrefix;
+                fresh.uploadModel(job.data);
+                target.swapContents(fresh);
+                // fresh now holds the old contents, its destructor releases their textures
+                fresh.releaseGeometry();
+                uploaded++;
+            }
+            loading.erase(model);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending--;
+            }
+
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (budgetMs > 0.0f && elapsed.count() >= budgetMs)
+                break;
+        }
+        return uploaded;
+    }
+
+    // blocks the GL thread until every requested model is uploaded, their textures may still be decoding
+    void finish()
+    {
+        while (true)
+        {
+            processUploads(0.0f);
+            std::unique_lock<std::mutex> lock(mutex);
+            if (pending == 0)
+                return;
+            idle.wait(lock, [this]() { return !completed.empty(); });
+        }
+    }
+
+    // requested and not yet uploaded
+    unsigned int pendingCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending;
+    }
+
+private:
+    struct Job {
+        Model *model = nullptr;
+        bool reload = false;
+        ModelData data;
+    };
+
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::deque<Job> completed;
+    // GL thread only: the models still loading, so none is destroyed on a worker
+    std::vector<std::shared_ptr<Model>> loading;
+    // requested but not yet uploaded / still being read on the pool
+    unsigned int pending = 0;
+    unsigned int reading = 0;
+    std::atomic<bool> stopping{false};
+
+    // reads the model on the pool, processUploads() picks it up from there
+    void read(const std::shared_ptr<Model> &model, bool reload, bool reimport)
+    {
+        loading.push_back(model);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending++;
+            reading++;
+        }
+        Model *target = model.get();
+        ThreadPool::shared().enqueue([this, target, reload, reimport]() {
+            Job job;
+            job.model = target;
+            job.reload = reload;
+            if (!stopping)
+                target->readModel(target->path, job.data, reimport);
+            // notified under the lock, the destructor may destroy the mutex as soon as reading reaches 0
+            std::lock_guard<std::mutex> lock(mutex);
+            completed.push_back(std::move(job));
+            reading--;
+            idle.notify_all();
+        });
+    }
+
+    ModelLoader()
+    {
+        // uploading takes texture references, so the caches and the pool must outlive the loader
+        ThreadPool::shared();
+        TextureLoader::instance();
+        TextureCache::instance();
+    }
+
+    ~ModelLoader()
+    {
+        stopping = true;
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return reading == 0; });
+    }
+};
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+#include <imgui.h>
+
+#include <learnopengl/render_stats.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// CPU and GPU time of the render loop stages. A scope takes a CPU timestamp at both ends and wraps its GL
+// commands in a GL_TIME_ELAPSED query. The queries of a frame are read back FRAME_LATENCY frames later, when the
+// GPU has long finished them, so the readback never waits; should the driver be further behind than that, the GPU
+// times of that frame are dropped instead.
+//
+//   profiler.beginFrame();
+//   {
+//       Profiler::Scope scope(profiler, "bombers");
+//       ...
+//   }
+//   profiler.endFrame();
+//
+// begin(name) and end() do the same around code that doesn't fit a block. GL_TIME_ELAPSED queries can't be
+// nested, so only the outermost open scope gets one, nested scopes are timed on the CPU only.
+class Profiler
+{
+public:
+    // query sets in flight, a frame's results are read when its set comes around again
+    static const unsigned int FRAME_LATENCY = 3;
+    // frames kept for the overlay graphs and the Chrome trace
+    static const unsigned int HISTORY_FRAMES = 300;
+
+    class Scope
+    {
+    public:
+        Scope(Profiler &profiler, const char *name) : profiler(profiler)
+        {
+            profiler.begin(name);
+        }
+        ~Scope()
+        {
+            profiler.end();
+        }
+    private:
+        Profiler &profiler;
+    };
+
+    // time of one stage in the last resolved frame, gpuMs is negative when it has no GPU time
+    struct Timing {
+        unsigned int stage;
+        double cpuMs, gpuMs;
+    };
+
+    Profiler() : epoch(Clock::now()), cpuHistory(HISTORY_FRAMES, 0.0f), gpuHistory(HISTORY_FRAMES, 0.0f) {}
+
+    // starts a frame and reads back the one issued FRAME_LATENCY frames ago
+    void beginFrame()
+    {
+        current = (current + 1) % FRAME_LATENCY;
+        Frame &frame = frames[current];
+        if (frame.used)
+            resolve(frame);
+        frame.samples.clear();
+        frame.used = true;
+        frame.start = now();
+        frame.end = frame.start;
+        open.clear();
+    }
+
+    void endFrame()
+    {
+        while (!open.empty())
+            end();
+        frames[current].end = now();
+    }
+
+    void begin(const char *name)
+    {
+        Frame &frame = frames[current];
+        Sample sample;
+        sample.stage = stageIndex(name);
+        sample.query = 0;
+        if (open.empty())
+        {
+            sample.query = acquireQuery();
+            glBeginQuery(GL_TIME_ELAPSED, sample.query);
+        }
+        sample.cpuStart = now();
+        sample.cpuEnd = sample.cpuStart;
+        open.push_back(frame.samples.size());
+        frame.samples.push_back(sample);
+    }
+
+    void end()
+    {
+        if (open.empty())
+            return;
+        Sample &sample = frames[current].samples[open.back()];
+        open.pop_back();
+        sample.cpuEnd = now();
+        if (sample.query)
+            glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    const std::string& stageName(unsigned int stage) const
+    {
+        return stages[stage].name;
+    }
+
+    // per stage times of the frame resolved in the last beginFrame()
+    const std::vector<Timing>& lastFrame() const
+    {
+        return resolved;
+    }
+
+    // table of the averaged stage times, the RenderStats counters so far and graphs of the frame times,
+    // between ImGui::NewFrame and ImGui::Render
+    void drawOverlay()
+    {
+        ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_Always);
+        ImGui::SetNextWindowBgAlpha(0.6f);
+        const ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings
+                                       | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoInputs;
+        if (ImGui::Begin("Profiler", NULL, flags))
+        {
+            ImGui::Text("%-18s %8s %8s", "stage", "CPU ms", "GPU ms");
+            ImGui::Separator();
+            for (const Stage &stage : stages)
+            {
+                if (stage.hasGpu)
+                    ImGui::Text("%-18s %8.3f %8.3f", stage.name.c_str(), stage.cpuMs, stage.gpuMs);
+                else
+                    ImGui::Text("%-18s %8.3f %8s", stage.name.c_str(), stage.cpuMs, "-");
+            }
+            ImGui::Separator();
+            ImGui::Text("%-18s %8.3f %8.3f", "frame", frameCpuMs, frameGpuMs);
+            const RenderStats &stats = RenderStats::frame();
+            ImGui::Text("%u draw calls, %u state changes, %u redundant ones skipped", stats.drawCalls, stats.stateChanges,
+                        stats.skippedStateChanges);
+            ImGui::Text("%u point lights, %u cluster references", stats.lights, stats.lightReferences);
+            ImGui::PlotLines("CPU", cpuHistory.data(), (int)HISTORY_FRAMES, (int)historyOffset, NULL, 0.0f, FLT_MAX, ImVec2(280.0f, 40.0f));
+            ImGui::PlotLines("GPU", gpuHistory.data(), (int)HISTORY_FRAMES, (int)historyOffset, NULL, 0.0f, FLT_MAX, ImVec2(280.0f, 40.0f));
+        }
+        ImGui::End();
+    }
+
+    // the last HISTORY_FRAMES resolved frames in the Chrome trace event format (chrome://tracing, Perfetto).
+    // The GPU only reports durations, so every GPU event is placed at the earliest point it can have run:
+    // after it was submitted and after the GPU event before it.
+    bool writeChromeTrace(const std::string &path) const
+    {
+        std::ofstream file(path);
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        file << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n";
+        file << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}";
+        for (const TraceFrame &frame : trace)
+        {
+            traceEvent(file, "frame", 1, frame.start, frame.end - frame.start);
+            for (const TraceEvent &event : frame.events)
+            {
+                traceEvent(file, stages[event.stage].name, 1, event.cpuStart, event.cpuDuration);
+                if (event.gpuDuration >= 0.0)
+                    traceEvent(file, stages[event.stage].name, 2, event.gpuStart, event.gpuDuration);
+            }
+        }
+        file << "\n]}\n";
+        if (!file)
+        {
+            std::cout << "PROFILER:: cannot write " << path << std::endl;
+            return false;
+        }
+        std::cout << "PROFILER:: wrote " << trace.size() << " frames to " << path << std::endl;
+        return true;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // times are in microseconds since the profiler was created
+    struct Sample {
+        unsigned int stage;
+        GLuint query;
+        double cpuStart, cpuEnd;
+    };
+
+    struct Frame {
+        std::vector<Sample> samples;
+        double start = 0.0, end = 0.0;
+        bool used = false;
+    };
+
+    // averaged over the last frames
+    struct Stage {
+        std::string name;
+        float cpuMs = 0.0f, gpuMs = 0.0f;
+        bool hasGpu = false;
+    };
+
+    struct TraceEvent {
+        unsigned int stage;
+        double cpuStart, cpuDuration, gpuStart, gpuDuration;
+    };
+
+    struct TraceFrame {
+        double start, end;
+        std::vector<TraceEvent> events;
+    };
+
+    // weight of the newest frame in the averages of the overlay
+    static constexpr float SMOOTHING = 0.05f;
+
+    Clock::time_point epoch;
+    Frame frames[FRAME_LATENCY];
+    unsigned int current = 0;
+    std::vector<size_t> open;
+    std::vector<GLuint> freeQueries;
+    std::vector<Stage> stages;
+    std::vector<Timing> resolved;
+    std::deque<TraceFrame> trace;
+    double gpuCursor = 0.0;
+    std::vector<float> cpuHistory, gpuHistory;
+    unsigned int historyOffset = 0;
+    float frameCpuMs = 0.0f, frameGpuMs = 0.0f;
+
+    double now() const
+    {
+        return std::chrono::duration<double, std::micro>(Clock::now() - epoch).count();
+    }
+
+    unsigned int stageIndex(const char *name)
+    {
+        for (size_t i = 0; i < stages.size(); i++)
+            if (stages[i].name == name)
+                return (unsigned int)i;
+        stages.push_back(Stage());
+        stages.back().name = name;
+        return (unsigned int)stages.size() - 1;
+    }
+
+    GLuint acquireQuery()
+    {
+        GLuint query;
+        if (freeQueries.empty())
+        {
+            glGenQueries(1, &query);
+            return query;
+        }
+        query = freeQueries.back();
+        freeQueries.pop_back();
+        return query;
+    }
+
+    void resolve(Frame &frame)
+    {
+        // queries finish in submission order, if the last one is done all of them are
+        bool gpuReady = true;
+        for (size_t i = frame.samples.size(); i-- > 0;)
+        {
+            if (frame.samples[i].query)
+            {
+                GLint available = 0;
+                glGetQueryObjectiv(frame.samples[i].query, GL_QUERY_RESULT_AVAILABLE, &available);
+                gpuReady = available != 0;
+                break;
+            }
+        }
+
+        resolved.clear();
+        TraceFrame traced;
+        traced.start = frame.start;
+        traced.end = frame.end;
+        double gpuTotal = 0.0;
+        for (const Sample &sample : frame.samples)
+        {
+            TraceEvent event;
+            event.stage = sample.stage;
+            event.cpuStart = sample.cpuStart;
+            event.cpuDuration = sample.cpuEnd - sample.cpuStart;
+            event.gpuStart = 0.0;
+            event.gpuDuration = -1.0;
+            if (sample.query)
+            {
+                if (gpuReady)
+                {
+                    GLuint64 nanoseconds = 0;
+                    glGetQueryObjectui64v(sample.query, GL_QUERY_RESULT, &nanoseconds);
+                    event.gpuDuration = (double)nanoseconds / 1000.0;
+                    event.gpuStart = std::max(sample.cpuStart, gpuCursor);
+                    gpuCursor = event.gpuStart + event.gpuDuration;
+                    gpuTotal += event.gpuDuration;
+                }
+                freeQueries.push_back(sample.query);
+            }
+            traced.events.push_back(event);
+
+            // a stage can be entered more than once per frame
+            std::vector<Timing>::iterator timing = std::find_if(resolved.begin(), resolved.end(),
+                                                                [&sample](const Timing &t) { return t.stage == sample.stage; });
+            if (timing == resolved.end())
+            {
+                resolved.push_back(Timing{sample.stage, 0.0, -1.0});
+                timing = resolved.end() - 1;
+            }
+            timing->cpuMs += event.cpuDuration / 1000.0;
+            if (event.gpuDuration >= 0.0)
+                timing->gpuMs = std::max(timing->gpuMs, 0.0) + event.gpuDuration / 1000.0;
+        }
+
+        for (const Timing &timing : resolved)
+        {
+            Stage &stage = stages[timing.stage];
+            stage.cpuMs += ((float)timing.cpuMs - stage.cpuMs) * SMOOTHING;
+            if (timing.gpuMs >= 0.0)
+            {
+                stage.gpuMs = stage.hasGpu ? stage.gpuMs + ((float)timing.gpuMs - stage.gpuMs) * SMOOTHING : (float)timing.gpuMs;
+                stage.hasGpu = true;
+            }
+        }
+        float cpuMs = (float)((frame.end - frame.start) / 1000.0), gpuMs = (float)(gpuTotal / 1000.0);
+        frameCpuMs += (cpuMs - frameCpuMs) * SMOOTHING;
+        if (gpuReady)
+            frameGpuMs += (gpuMs - frameGpuMs) * SMOOTHING;
+        cpuHistory[historyOffset] = cpuMs;
+        gpuHistory[historyOffset] = gpuReady ? gpuMs : 0.0f;
+        historyOffset = (historyOffset + 1) % HISTORY_FRAMES;
+
+        trace.push_back(std::move(traced));
+        if (trace.size() > HISTORY_FRAMES)
+            trace.pop_front();
+    }
+
+    static void traceEvent(std::ofstream &file, const std::string &name, int thread, double start, double duration)
+    {
+        file << ",\n  {\"name\": \"" << name << "\", \"cat\": \"" << (thread == 1 ? "cpu" : "gpu") << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+             << thread << ", \"ts\": " << start << ", \"dur\": " << duration << "}";
+    }
+};
+
+#endif
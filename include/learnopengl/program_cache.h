@@ -0,0 +1,254 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/filesystem.h>
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// ARB_get_program_binary (core in GL 4.1), not part of the GL 3.3 glad loader
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH           0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS      0x87FE
+#endif
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+// Linked programs saved with glGetProgramBinary under resources/cache/shaders, so that a later start skips
+// compiling and linking. The file name is a hash of the sources of every stage (after Shader added its
+// #defines) and of the GL vendor, renderer and version strings, a driver update therefore just misses.
+// A driver may still reject a binary it wrote itself; load() then deletes the file and the Shader compiles
+// from source as if there was no cache, storing a fresh binary.
+//
+// Does nothing until init() found program binary support, Shader compiles every program then.
+//
+// layout: Header, binary
+class ProgramCache
+{
+public:
+    static const uint32_t MAGIC   = 0x4E425053; // "SPBN"
+    static const uint32_t VERSION = 1;
+
+    struct Stats {
+        unsigned int loaded = 0, compiled = 0, rejected = 0;
+        // time spent loading binaries and building from source, and what building the loaded ones took
+        // when they were stored
+        double loadMs = 0.0, compileMs = 0.0, savedMs = 0.0;
+    };
+
+    static ProgramCache& instance()
+    {
+        static ProgramCache cache;
+        return cache;
+    }
+
+    // enables the cache if the context has program binaries, loadProc is the loader GL was loaded with
+    void init(GLADloadproc loadProc)
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        glGetError(); // GL_INVALID_ENUM without the extension
+        getProgramBinary = (PFNGLGETPROGRAMBINARYPROC)loadProc("glGetProgramBinary");
+        programBinary = (PFNGLPROGRAMBINARYPROC)loadProc("glProgramBinary");
+        programParameteri = (PFNGLPROGRAMPARAMETERIPROC)loadProc("glProgramParameteri");
+        if (formats <= 0 || !getProgramBinary || !programBinary || !programParameteri)
+        {
+            getProgramBinary = nullptr;
+            std::cout << "PROGRAM_CACHE:: no program binary formats, shaders are compiled on every start" << std::endl;
+            return;
+        }
+        const char *strings[] = {(const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER),
+                                 (const char*)glGetString(GL_VERSION)};
+        driverHash = OFFSET_BASIS;
+        for (const char *string : strings)
+            if (string)
+                driverHash = fnv1a(string, std::strlen(string) + 1, driverHash);
+    }
+
+    bool enabled() const
+    {
+        return getProgramBinary != nullptr;
+    }
+
+    // key of the program built from these sources on this driver, geometry is empty without a geometry stage
+    uint64_t key(const std::string &vertex, const std::string &fragment, const std::string &geometry) const
+    {
+        uint64_t hash = driverHash;
+        for (const std::string *source : {&vertex, &fragment, &geometry})
+        {
+            uint64_t size = source->size();
+            hash = fnv1a(&size, sizeof(size), hash);
+            hash = fnv1a(source->data(), source->size(), hash);
+        }
+        return hash;
+    }
+
+    // a program linked from the binary stored under key, 0 if there is none or the driver rejects it
+    GLuint load(uint64_t key)
+    {
+        if (!enabled())
+            return 0;
+        auto start = std::chrono::steady_clock::now();
+        std::string path = pathFor(key);
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file)
+            return 0;
+        // the binary must fill the rest of the file exactly, a truncated or corrupt header never sizes the allocation
+        struct stat info;
+        Header header;
+        std::vector<char> binary;
+        bool read = fstat(fileno(file), &info) == 0 && fread(&header, sizeof(header), 1, file) == 1
+                    && header.magic == MAGIC && header.version == VERSION && header.key == key
+                    && (uint64_t)info.st_size - sizeof(header) == header.length;
+        if (read)
+        {
+            binary.resize(header.length);
+            read = fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+        fclose(file);
+
+        GLuint program = 0;
+        GLint linked = GL_FALSE;
+        if (read)
+        {
+            program = glCreateProgram();
+            programBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        }
+        if (!linked)
+        {
+            if (program)
+                glDeleteProgram(program);
+            remove(path.c_str());
+            counters.rejected++;
+            std::cout << "PROGRAM_CACHE:: discarding binary " << path << std::endl;
+            return 0;
+        }
+        counters.loaded++;
+        counters.loadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        counters.savedMs += header.compileMs;
+        return program;
+    }
+
+    // asks the driver to keep the binary of a program about to be linked
+    void prepare(GLuint program)
+    {
+        if (enabled())
+            programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // writes the binary of a program that was just linked from source in compileMs milliseconds. The file is
+    // written to a temporary name and renamed into place, like the mesh cache.
+    void store(GLuint program, uint64_t key, double compileMs)
+    {
+        counters.compiled++;
+        counters.compileMs += compileMs;
+        GLint length = 0;
+        if (!enabled() || !makeDirectories(cacheDirectory()))
+            return;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        Header header;
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.key = key;
+        header.compileMs = compileMs;
+        std::vector<char> binary((size_t)length);
+        GLsizei written = 0;
+        getProgramBinary(program, length, &written, &header.format, binary.data());
+        if (written <= 0)
+            return;
+        header.length = (uint32_t)written;
+
+        std::string path = pathFor(key);
+        std::string temporaryPath = path + ".tmp";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "PROGRAM_CACHE:: cannot write " << temporaryPath << std::endl;
+            return;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, header.length, file) == header.length;
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(temporaryPath.c_str(), path.c_str()) != 0)
+            remove(temporaryPath.c_str());
+    }
+
+    const Stats& stats() const
+    {
+        return counters;
+    }
+
+    static std::string cacheDirectory()
+    {
+        return FileSystem::getPath("resources/cache/shaders");
+    }
+
+private:
+    static const uint64_t OFFSET_BASIS = 14695981039346656037ull;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        GLenum   format;
+        uint32_t length;
+        double   compileMs;
+    };
+
+    PFNGLGETPROGRAMBINARYPROC getProgramBinary = nullptr;
+    PFNGLPROGRAMBINARYPROC programBinary = nullptr;
+    PFNGLPROGRAMPARAMETERIPROC programParameteri = nullptr;
+    uint64_t driverHash = OFFSET_BASIS;
+    Stats counters;
+
+    ProgramCache() {}
+
+    static std::string pathFor(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+        return cacheDirectory() + name;
+    }
+
+    static uint64_t fnv1a(const void *data, size_t size, uint64_t hash)
+    {
+        const unsigned char *bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static bool makeDirectories(const std::string &path)
+    {
+        for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+        {
+            std::string prefix = path.substr(0, slash);
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+            {
+                std::cout << "PROGRAM_CACHE:: cannot create directory " << prefix << std::endl;
+                return false;
+            }
+            if (slash == std::string::npos)
+                return true;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/uniform_ring.h>
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+// std140 mirror of the per-draw uniform block Draw of the scene shaders (see scene_light.vs)
+struct DrawBlock {
+    glm::mat4 model;
+    // dequantization of the PackedVertex layout
+    glm::vec3 positionScale;
+    GLint packedVertex;
+    glm::vec3 positionOffset;
+    // the maps come from the mesh's texture array layers
+    GLint textureArrays;
+};
+
+// draw of a batch of meshes recorded by Model::Draw / Model::DrawInstanced for later execution
+struct RenderCommand {
+    uint64_t key;
+    MeshBatch batch;
+    Shader *shader;
+    bool twoSided;
+    // 0 for a single draw with the model matrix below, else the instance range of instanceBuffer to draw;
+    // instanceBuffer 0 is the queue's own buffer, holding the matrices given to RenderQueue::addInstances
+    unsigned int instanceCount;
+    unsigned int instanceBuffer;
+    size_t instanceOffset;
+    GLint modelLocation;
+    glm::mat4 model;
+    // offset of the command's DrawBlock in the uniform ring, set by execute
+    size_t uniformOffset;
+};
+
+// Draw commands of a frame, sorted by a 64 bit key before they are executed so that draws sharing state end up
+// next to each other. From the most to the least significant bits:
+//   63-62 pass
+//   61    two sided, culled geometry first so GL_CULL_FACE changes at most once per pass
+//   60-51 shader program, numbered per frame by programId
+//   50-35 material, the texture set of the mesh, numbered per frame by materialId
+//   34-11 distance to the camera, front to back so early depth testing rejects hidden fragments
+// The keys are radix sorted, which keeps commands with equal keys in submission order.
+//
+// With a depth pre-pass every command is drawn twice: first into the depth buffer only, with a shader that
+// just transforms positions (and the position-only vertex arrays, see Model::POSITION_STREAM), sorted front
+// to back regardless of material; then as submitted with GL_EQUAL and without depth writes, so the scene
+// shader runs once per pixel, for the fragment that is visible. The vertex shaders of both passes must
+// compute gl_Position with the same expression and declare it invariant, or GL_EQUAL drops fragments.
+class RenderQueue
+{
+public:
+    enum Pass {
+        DEPTH_PASS = 0,
+        OPAQUE_PASS = 1
+    };
+
+    // binding point of the Draw uniform block, the scene shaders bind their block to it
+    static const GLuint DRAW_BLOCK_BINDING = 2;
+
+    ~RenderQueue()
+    {
+        release();
+    }
+
+    // deletes the instance buffer, must be called while the context is still current (the destructor does it
+    // too, for queues that go away before the context)
+    void release()
+    {
+        if (instanceVBO)
+            GLState::instance().deleteBuffer(instanceVBO);
+        instanceVBO = 0;
+        instanceCapacity = 0;
+    }
+
+    // a new command to fill in. Commands are reused between frames so their batches keep their memory.
+    RenderCommand& submit()
+    {
+        if (used == commands.size())
+            commands.emplace_back();
+        RenderCommand &command = commands[used++];
+        command.batch.clear();
+        command.instanceCount = 0;
+        command.instanceBuffer = 0;
+        command.instanceOffset = 0;
+        command.modelLocation = -1;
+        return command;
+    }
+
+    // shaders of the depth pre-pass for single and for instanced draws, both reading the Draw block; nullptr
+    // turns the pre-pass off
+    void setDepthPrePass(Shader *shader, Shader *instancedShader)
+    {
+        depthShader = shader;
+        depthShaderInstanced = instancedShader;
+    }
+
+    bool depthPrePass() const
+    {
+        return depthShader && depthShaderInstanced;
+    }
+
+    static uint64_t makeKey(Pass pass, bool twoSided, unsigned int program, unsigned int material, float distance)
+    {
+        // the bits of a non-negative float sort like the float, the top 24 keep 15 bits of mantissa
+        uint32_t distanceBits;
+        distance = std::max(distance, 0.0f);
+        std::memcpy(&distanceBits, &distance, sizeof(distanceBits));
+        assert(program <= PROGRAM_MASK && material <= MATERIAL_MASK);
+        return ((uint64_t)(pass & 0x3) << 62) | ((uint64_t)(twoSided ? 1 : 0) << 61) | ((uint64_t)(program & PROGRAM_MASK) << 51)
+               | ((uint64_t)(material & MATERIAL_MASK) << 35) | ((uint64_t)(distanceBits >> 8) << 11);
+    }
+
+    // small sequential id of a shader program for the sort key, GL names are too sparse for its 10 bits.
+    // Like material ids, they only hold until execute().
+    unsigned int programId(const Shader &shader)
+    {
+        std::map<unsigned int, unsigned int>::iterator program = programs.find(shader.ID);
+        if (program != programs.end())
+            return program->second;
+        unsigned int id = (unsigned int)programs.size();
+        assert(id <= PROGRAM_MASK);
+        programs.emplace(shader.ID, id);
+        return id;
+    }
+
+    // small sequential id of a texture set for the sort key, meshes with the same textures bound to the same
+    // units share it. The ids only hold until execute() and are handed out again next frame, so they never
+    // outlive the textures they were given for.
+    unsigned int materialId(const vector<Texture> &textures)
+    {
+        materialNames.clear();
+        for (const Texture &texture : textures)
+            materialNames.push_back(texture.id);
+        std::map<vector<unsigned int>, unsigned int>::iterator material = materials.find(materialNames);
+        if (material != materials.end())
+            return material->second;
+        unsigned int id = (unsigned int)materials.size();
+        assert(id <= MATERIAL_MASK);
+        materials.emplace(materialNames, id);
+        return id;
+    }
+
+    // copies model matrices for the instanced draws of this frame, execute() uploads all of them at once.
+    // Returns the byte offset of the first one in the queue's instance buffer, for RenderCommand::instanceOffset.
+    size_t addInstances(const glm::mat4 *models, unsigned int count)
+    {
+        size_t offset = instances.size() * sizeof(glm::mat4);
+        instances.insert(instances.end(), models, models + count);
+        return offset;
+    }
+
+    size_t size() const
+    {
+        return used;
+    }
+
+    // sorts and draws everything submitted, then empties the queue. The DrawBlock of every command is written
+    // to the ring first, each draw then only binds its range. Commands with a valid modelLocation are for
+    // shaders without the Draw block and get the model matrix as a plain uniform. Leaves GL_LESS depth
+    // testing with depth and color writes on.
+    void execute(UniformRing &uniforms)
+    {
+        sort();
+        uploadInstances();
+        for (size_t index = 0; index < used; index++)
+        {
+            RenderCommand &command = commands[index];
+            const Mesh &mesh = *command.batch.first;
+            DrawBlock block;
+            block.model = command.model;
+            block.packedVertex = mesh.packed;
+            block.positionScale = mesh.sharedBuffers()->positionScale;
+            block.positionOffset = mesh.sharedBuffers()->positionOffset;
+            block.textureArrays = mesh.textureLayer >= 0;
+            command.uniformOffset = uniforms.write(&block, sizeof(block));
+        }
+        uniforms.flush();
+
+        GLState &state = GLState::instance();
+        bool depthOnly = depthPrePass();
+        if (depthOnly)
+        {
+            state.colorMask(false);
+            state.depthMask(true);
+            state.depthFunc(GL_LESS);
+        }
+        for (unsigned int entry : order)
+        {
+            RenderCommand &command = commands[entry & ~DEPTH_ENTRY];
+            state.set(GL_CULL_FACE, !command.twoSided);
+            if (entry & DEPTH_ENTRY)
+            {
+                Shader &shader = command.instanceCount == 0 ? *depthShader : *depthShaderInstanced;
+                shader.use();
+                uniforms.bind(DRAW_BLOCK_BINDING, command.uniformOffset, sizeof(DrawBlock));
+                if (command.instanceCount != 0)
+                    command.batch.first->setupInstanceAttributes(command.instanceBuffer, command.instanceOffset, true);
+                command.batch.drawDepth(command.instanceCount);
+                continue;
+            }
+            if (depthOnly)
+            {
+                // the depth buffer is complete, only the fragment that left its depth there is shaded
+                depthOnly = false;
+                state.colorMask(true);
+                state.depthMask(false);
+                state.depthFunc(GL_EQUAL);
+            }
+            command.shader->use();
+            uniforms.bind(DRAW_BLOCK_BINDING, command.uniformOffset, sizeof(DrawBlock));
+            if (command.instanceCount == 0)
+            {
+                if (command.modelLocation >= 0)
+                    command.shader->setMat4(command.modelLocation, command.model);
+                command.batch.draw(*command.shader);
+            }
+            else
+            {
+                command.batch.first->setupInstanceAttributes(command.instanceBuffer, command.instanceOffset);
+                command.batch.drawInstanced(*command.shader, command.instanceCount);
+            }
+        }
+        state.enable(GL_CULL_FACE);
+        state.colorMask(true);
+        state.depthMask(true);
+        state.depthFunc(GL_LESS);
+        used = 0;
+        materials.clear();
+        programs.clear();
+        instances.clear();
+    }
+
+private:
+    // order entries of the depth pre-pass draws of a command
+    static const unsigned int DEPTH_ENTRY = 1u << 31;
+    // the distance bits of a key
+    static const uint64_t DISTANCE_BITS = 0xFFFFFFull << 11;
+    // the 16 bits a material id has in the key
+    static const unsigned int MATERIAL_MASK = 0xFFFF;
+    // the 10 bits a program id has in the key
+    static const unsigned int PROGRAM_MASK = 0x3FF;
+
+    vector<RenderCommand> commands;
+    size_t used = 0;
+    Shader *depthShader = nullptr;
+    Shader *depthShaderInstanced = nullptr;
+    // command indices in key order, and the scratch buffers of the sort
+    vector<unsigned int> order, scratch;
+    vector<uint64_t> keys, keyScratch;
+    // texture names of a material -> its id this frame, see materialId
+    std::map<vector<unsigned int>, unsigned int> materials;
+    vector<unsigned int> materialNames;
+    // GL name of a program -> its id this frame, see programId
+    std::map<unsigned int, unsigned int> programs;
+    // model matrices of the instanced draws of this frame, and the buffer execute() uploads them to
+    vector<glm::mat4> instances;
+    unsigned int instanceVBO = 0;
+    size_t instanceCapacity = 0;
+
+    void uploadInstances()
+    {
+        if (instances.empty())
+            return;
+        if (instanceVBO == 0)
+            glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (instances.size() > instanceCapacity)
+        {
+            instanceCapacity = instances.size();
+            glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::mat4), instances.data(), GL_STREAM_DRAW);
+        }
+        else
+        {
+            // orphan the old storage so we don't wait for draws of the previous frame still reading it
+            glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(glm::mat4), instances.data());
+        }
+        for (size_t index = 0; index < used; index++)
+        {
+            if (commands[index].instanceCount != 0 && commands[index].instanceBuffer == 0)
+                commands[index].instanceBuffer = instanceVBO;
+        }
+    }
+
+    // LSD radix sort of the keys, one byte per pass. Passes in which every key has the same byte are skipped,
+    // which in practice leaves only the few bytes that differ. With the depth pre-pass every command is in the
+    // order twice, once more with DEPTH_ENTRY set and a key of the depth pass without the material.
+    void sort()
+    {
+        size_t count = depthPrePass() ? 2 * used : used;
+        order.resize(count);
+        scratch.resize(count);
+        keys.resize(count);
+        keyScratch.resize(count);
+        for (size_t i = 0; i < used; i++)
+        {
+            order[i] = (unsigned int)i;
+            keys[i] = commands[i].key;
+        }
+        for (size_t i = used; i < count; i++)
+        {
+            const RenderCommand &command = commands[i - used];
+            Shader *shader = command.instanceCount == 0 ? depthShader : depthShaderInstanced;
+            order[i] = (unsigned int)(i - used) | DEPTH_ENTRY;
+            keys[i] = makeKey(DEPTH_PASS, command.twoSided, programId(*shader), 0, 0.0f) | (command.key & DISTANCE_BITS);
+        }
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            size_t histogram[257] = {};
+            for (size_t i = 0; i < count; i++)
+                histogram[((keys[i] >> shift) & 0xFF) + 1]++;
+            if (count == 0 || histogram[((keys[0] >> shift) & 0xFF) + 1] == count)
+                continue;
+            for (unsigned int digit = 0; digit < 256; digit++)
+                histogram[digit + 1] += histogram[digit];
+            for (size_t i = 0; i < count; i++)
+            {
+                size_t destination = histogram[(keys[i] >> shift) & 0xFF]++;
+                keyScratch[destination] = keys[i];
+                scratch[destination] = order[i];
+            }
+            keys.swap(keyScratch);
+            order.swap(scratch);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <cstdint>
+
+// Draw call and triangle counters of the current frame. Everything that issues a draw call reports it here,
+// main.cpp resets the counters at the start of every frame. GLState adds the state changes it passed on to GL
+// and the redundant ones it dropped.
+struct RenderStats {
+    unsigned int drawCalls = 0;
+    uint64_t triangles = 0;
+    unsigned int stateChanges = 0;
+    unsigned int skippedStateChanges = 0;
+    // clustered point lights and their references in the cluster lists, see LightClusters
+    unsigned int lights = 0;
+    unsigned int lightReferences = 0;
+
+    static RenderStats& frame()
+    {
+        static RenderStats stats;
+        return stats;
+    }
+
+    void reset()
+    {
+        drawCalls = 0;
+        triangles = 0;
+        stateChanges = 0;
+        skippedStateChanges = 0;
+        lights = 0;
+        lightReferences = 0;
+    }
+
+    void draw(uint64_t triangleCount)
+    {
+        drawCalls++;
+        triangles += triangleCount;
+    }
+};
+
+#endif
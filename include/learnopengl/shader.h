@@ -4,18 +4,26 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 #include <common.h>
+#include <learnopengl/asset_package.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/program_cache.h>
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, every name in defines is #defined at the top of each stage
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::vector<std::string> &defines = std::vector<std::string>())
     {
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
@@ -33,6 +41,10 @@ public:
         vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
         fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
         gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        // sources in the asset package are taken from its mapping, otherwise all of them are read from disk
+        bool packaged = readPackaged(vertexPath, vertexCode) && readPackaged(fragmentPath, fragmentCode)
+                        && (geometryPath == nullptr || readPackaged(geometryPath, geometryCode));
+        if (!packaged)
         try 
         {
             // open files
@@ -64,9 +76,27 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        if (!defines.empty())
+        {
+            vertexCode = withDefines(vertexCode, defines);
+            fragmentCode = withDefines(fragmentCode, defines);
+            if(geometryPath != nullptr)
+                geometryCode = withDefines(geometryCode, defines);
+        }
+        // 2. a program the driver linked from the same sources before is taken from the binary cache
+        ProgramCache &programCache = ProgramCache::instance();
+        uint64_t programKey = programCache.key(vertexCode, fragmentCode, geometryCode);
+        ID = programCache.load(programKey);
+        if (ID != 0)
+        {
+            linked = true;
+            cacheUniformLocations();
+            return;
+        }
+        auto compileStart = std::chrono::steady_clock::now();
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -90,6 +120,7 @@ public:
         }
         // shader Program
         ID = glCreateProgram();
+        programCache.prepare(ID);
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
@@ -101,74 +132,219 @@ public:
         glDeleteShader(fragment);
         if(geometryPath != nullptr)
             glDeleteShader(geometry);
+        GLint linkStatus = GL_FALSE;
+        glGetProgramiv(ID, GL_LINK_STATUS, &linkStatus);
+        linked = linkStatus == GL_TRUE;
+        if (linked)
+            programCache.store(ID, programKey, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count());
 
+        cacheUniformLocations();
+    }
+    // false if a stage failed to compile or the program to link, the errors were printed already
+    bool isLinked() const
+    {
+        return linked;
+    }
+    // distinct for every program ever built in this process, unlike ID, which GL reuses once a program is deleted.
+    // ShaderPermutations::reload swaps the Shader contents, so a reloaded shader reports a new generation.
+    uint64_t generation() const
+    {
+        return programGeneration;
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        GLState::instance().useProgram(ID);
+    }
+    // uniform locations are read once after linking; look them up before the render loop and pass the
+    // returned handle to the setters below, so the hot path does no string hashing or GL queries.
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(const std::string &name) const
+    {
+        auto it = uniformLocations.find(name);
+        if (it != uniformLocations.end())
+            return it->second;
+        // not an active uniform, remember that as well so we don't ask the driver again
+        GLint location = glGetUniformLocation(ID, name.c_str());
+        uniformLocations.emplace(name, location);
+        return location;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        setBool(getUniformLocation(name), value);
+    }
+    void setBool(GLint location, bool value) const
+    {
+        glUniform1i(location, (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        setInt(getUniformLocation(name), value);
+    }
+    void setInt(GLint location, int value) const
+    {
+        glUniform1i(location, value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        setFloat(getUniformLocation(name), value);
+    }
+    void setFloat(GLint location, float value) const
+    {
+        glUniform1f(location, value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec2(getUniformLocation(name), value);
+    }
+    void setVec2(GLint location, const glm::vec2 &value) const
+    {
+        glUniform2fv(location, 1, &value[0]);
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(getUniformLocation(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec3(getUniformLocation(name), value);
+    }
+    void setVec3(GLint location, const glm::vec3 &value) const
+    {
+        glUniform3fv(location, 1, &value[0]);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(getUniformLocation(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec4(getUniformLocation(name), value);
+    }
+    void setVec4(GLint location, const glm::vec4 &value) const
+    {
+        glUniform4fv(location, 1, &value[0]);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(getUniformLocation(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(getUniformLocation(name), mat);
+    }
+    void setMat3(GLint location, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(getUniformLocation(name), mat);
+    }
+    void setMat4(GLint location, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
+    // ------------------------------------------------------------------------
+    // points the uniform block name at a binding point, GLSL 330 has no layout(binding) for blocks.
+    // Returns false if the program has no such active block.
+    bool bindUniformBlock(const std::string &name, GLuint binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, name.c_str());
+        if (index == GL_INVALID_INDEX)
+            return false;
+        glUniformBlockBinding(ID, index, binding);
+        return true;
     }
 
 private:
+    bool linked = false;
+    uint64_t programGeneration = nextGeneration();
+    // name -> location of every active uniform, array elements included
+    mutable std::unordered_map<std::string, GLint> uniformLocations;
+
+    static uint64_t nextGeneration()
+    {
+        static uint64_t generations = 0;
+        return ++generations;
+    }
+
+    // reads the active uniforms of the freshly linked program into the location table
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        uniformLocations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0)
+                continue; // members of uniform blocks have no location
+            uniformLocations[name] = location;
+            // arrays are reported as "name[0]", make the plain name and the other elements reachable too
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                uniformLocations[base] = location;
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+    }
+
+    // source of the shader at path from the open AssetPackage
+    // ------------------------------------------------------------------------
+    static bool readPackaged(const char *path, std::string &code)
+    {
+        AssetBlob packaged;
+        if (!AssetPackage::instance().find(path, packaged))
+            return false;
+        code.assign((const char*)packaged.data, packaged.size);
+        return true;
+    }
+
+    // code with a #define of every name after its #version line, which has to stay the first statement
+    // ------------------------------------------------------------------------
+    static std::string withDefines(const std::string &code, const std::vector<std::string> &defines)
+    {
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        size_t split = lineEnd == std::string::npos ? 0 : lineEnd + 1;
+        // count the lines before the split, so compile errors keep pointing at the lines of the file
+        size_t line = 1 + (size_t)std::count(code.begin(), code.begin() + split, '\n');
+        std::string header;
+        for (const std::string &define : defines)
+            header += "#define " + define + "\n";
+        header += "#line " + std::to_string(line) + "\n";
+        return code.substr(0, split) + header + code.substr(split);
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
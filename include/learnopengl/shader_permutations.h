@@ -0,0 +1,117 @@
+#ifndef SHADER_PERMUTATIONS_H
+#define SHADER_PERMUTATIONS_H
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Programs built from the same sources with different sets of compile time features. Feature i of the list is
+// #defined in the program of every mask with bit i set, so the shader can leave out what the mask turns off
+// (#ifdef FEATURE) instead of branching on a uniform for every fragment. Each combination is compiled once, the
+// first time it is asked for, and setup is called on it right after so that uniforms that never change (sampler
+// units, block bindings...) are set in every program.
+// reload() builds every compiled combination again from the sources on disk, for editing shaders while the
+// program runs; the Shader objects stay the same, so references to them remain valid.
+//
+//   ShaderPermutations scene("scene.vs", "scene.fs", {"BLINN", "FLASH_LIGHT"}, setConstants);
+//   Shader &shader = scene.get((blinn ? 1 : 0) | (flashLight ? 2 : 0));
+class ShaderPermutations
+{
+public:
+    ShaderPermutations(const std::string &vertexPath, const std::string &fragmentPath, const std::vector<std::string> &features,
+                       std::function<void(Shader&)> setup = nullptr)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), features(features), setup(std::move(setup)) {}
+
+    ShaderPermutations(const ShaderPermutations &) = delete;
+    ShaderPermutations& operator=(const ShaderPermutations &) = delete;
+
+    // program of the features in mask, compiled on the first call with that mask
+    Shader& get(unsigned int mask)
+    {
+        mask &= allFeatures();
+        auto found = programs.find(mask);
+        if (found != programs.end())
+            return *found->second;
+
+        std::unique_ptr<Shader> &program = programs[mask];
+        program.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, definesOf(mask)));
+        if (setup)
+            setup(*program);
+        return *program;
+    }
+
+    // compiles every combination of the features in features up front, so that switching them later never
+    // stalls a frame
+    void compileAll(unsigned int features = ~0u)
+    {
+        for (unsigned int mask = 0; mask <= allFeatures(); mask++)
+            if ((mask & ~features) == 0)
+                get(mask);
+    }
+
+    // true if path is one of the source files
+    bool uses(const std::string &path) const
+    {
+        return path == vertexPath || path == fragmentPath;
+    }
+
+    // compiles every combination built so far again. The new programs replace the old ones only if all of them
+    // link, otherwise the old ones stay in use and false is returned. Call it between frames, the queued draws
+    // reference the programs by name.
+    bool reload()
+    {
+        std::unordered_map<unsigned int, std::unique_ptr<Shader>> rebuilt;
+        bool linked = true;
+        for (const auto &program : programs)
+        {
+            std::unique_ptr<Shader> &shader = rebuilt[program.first];
+            shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, definesOf(program.first)));
+            linked = linked && shader->isLinked();
+        }
+        for (auto &program : rebuilt)
+        {
+            if (linked)
+            {
+                if (setup)
+                    setup(*program.second);
+                // swap the contents, so the Shader everyone holds now refers to the new program
+                std::swap(*programs[program.first], *program.second);
+            }
+            GLState::instance().deleteProgram(program.second->ID);
+        }
+        return linked;
+    }
+
+    // combinations compiled so far
+    size_t size() const
+    {
+        return programs.size();
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    std::vector<std::string> features;
+    std::function<void(Shader&)> setup;
+    std::unordered_map<unsigned int, std::unique_ptr<Shader>> programs;
+
+    std::vector<std::string> definesOf(unsigned int mask) const
+    {
+        std::vector<std::string> defines;
+        for (size_t feature = 0; feature < features.size(); feature++)
+            if (mask & (1u << feature))
+                defines.push_back(features[feature]);
+        return defines;
+    }
+
+    unsigned int allFeatures() const
+    {
+        return (1u << features.size()) - 1;
+    }
+};
+
+#endif
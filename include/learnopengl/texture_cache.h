@@ -0,0 +1,235 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <learnopengl/asset_package.h>
+#include <learnopengl/texture_loader.h>
+
+#include <sys/stat.h>
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide, reference counted cache of the 2D textures loaded from files. A texture is found by the
+// canonical absolute path of its file and, on a miss, by the file contents: a loaded file of the same size and
+// color space is compared byte for byte, so models referencing the same image through different paths, or
+// shipping their own copy of it, share one GL texture. Only files whose size matches a loaded one are read here,
+// every other miss goes straight to the loader. Every acquire() is paired with a release(); the GL name is
+// deleted with the last reference. reload() picks up a file that changed on disk. GL thread only.
+class TextureCache
+{
+public:
+    struct Stats {
+        unsigned int textures = 0;    // distinct GL textures
+        unsigned int references = 0;  // acquires not yet released
+        unsigned int pathHits = 0;    // acquires of a path already loaded
+        unsigned int contentHits = 0; // acquires of a new path with the contents of a loaded file
+        unsigned int misses = 0;      // acquires that loaded a file
+        size_t bytes = 0;             // estimated GPU memory of the textures uploaded so far
+    };
+
+    static TextureCache& instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // the texture of the image at path, loaded through TextureLoader if it isn't cached
+    unsigned int acquire(const std::string &path, bool gamma = false)
+    {
+        std::string file = canonicalPath(path);
+        std::string key = file + (gamma ? "|srgb" : "");
+        std::unordered_map<std::string, unsigned int>::iterator byPath = paths.find(key);
+        if (byPath != paths.end())
+        {
+            entries[byPath->second].references++;
+            counters.pathHits++;
+            return byPath->second;
+        }
+
+        uint64_t size = 0;
+        bool sized = fileSize(path, size);
+        if (sized)
+        {
+            auto candidates = sizes.equal_range(size);
+            for (auto candidate = candidates.first; candidate != candidates.second; ++candidate)
+            {
+                Entry &entry = entries[candidate->second];
+                if (entry.gamma != gamma || !sameContents(entry.file, path))
+                    continue;
+                entry.references++;
+                entry.paths.push_back(key);
+                paths[key] = candidate->second;
+                counters.contentHits++;
+                return candidate->second;
+            }
+        }
+
+        unsigned int textureID = TextureLoader::instance().load2D(path, gamma);
+        Entry &entry = entries[textureID];
+        entry.references = 1;
+        entry.paths.push_back(key);
+        entry.file = file;
+        entry.gamma = gamma;
+        entry.sized = sized;
+        entry.size = size;
+        paths[key] = textureID;
+        if (sized)
+            sizes.insert(std::make_pair(size, textureID));
+        counters.misses++;
+        return textureID;
+    }
+
+    // drops one reference, the texture is deleted with the last one
+    void release(unsigned int textureID)
+    {
+        std::unordered_map<unsigned int, Entry>::iterator entry = entries.find(textureID);
+        if (entry == entries.end() || --entry->second.references > 0)
+            return;
+        for (const std::string &key : entry->second.paths)
+            paths.erase(key);
+        forgetContents(textureID, entry->second);
+        entries.erase(entry);
+        TextureLoader::instance().deleteTexture(textureID);
+    }
+
+    // loads the textures of the image at path again, keeping their names, and returns how many there were.
+    // A precompressed .dds counts as the image with the same name, the loader decides which of the two is used.
+    unsigned int reload(const std::string &path)
+    {
+        std::string changed = canonicalPath(path);
+        unsigned int reloaded = 0;
+        for (auto &entry : entries)
+        {
+            for (const std::string &key : entry.second.paths)
+            {
+                bool gamma = key.size() > 5 && key.compare(key.size() - 5, 5, "|srgb") == 0;
+                std::string file = gamma ? key.substr(0, key.size() - 5) : key;
+                if (file != changed && withoutExtension(file) + ".dds" != changed)
+                    continue;
+                TextureLoader::instance().reload2D(entry.first, file, gamma);
+                // the contents no longer match the file it was loaded from, other paths must not share it anymore
+                forgetContents(entry.first, entry.second);
+                reloaded++;
+                break;
+            }
+        }
+        return reloaded;
+    }
+
+    Stats stats() const
+    {
+        Stats stats = counters;
+        for (const auto &entry : entries)
+        {
+            stats.textures++;
+            stats.references += entry.second.references;
+            stats.bytes += TextureLoader::instance().textureBytes(entry.first);
+        }
+        return stats;
+    }
+
+private:
+    struct Entry {
+        unsigned int references = 0;
+        // every cache key that leads here
+        std::vector<std::string> paths;
+        // the file the texture was loaded from, new paths are compared with it
+        std::string file;
+        bool gamma = false;
+        bool sized = false;
+        uint64_t size = 0;
+    };
+
+    std::unordered_map<unsigned int, Entry> entries;
+    std::unordered_map<std::string, unsigned int> paths;
+    // file size -> textures that can be shared with a file of that size
+    std::unordered_multimap<uint64_t, unsigned int> sizes;
+    Stats counters;
+
+    TextureCache() {}
+
+    void forgetContents(unsigned int textureID, Entry &entry)
+    {
+        if (!entry.sized)
+            return;
+        auto candidates = sizes.equal_range(entry.size);
+        for (auto candidate = candidates.first; candidate != candidates.second; ++candidate)
+        {
+            if (candidate->second == textureID)
+            {
+                sizes.erase(candidate);
+                break;
+            }
+        }
+        entry.sized = false;
+    }
+
+    static std::string canonicalPath(const std::string &path)
+    {
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return resolved;
+        return AssetPackage::normalize(path);
+    }
+
+    static std::string withoutExtension(const std::string &path)
+    {
+        size_t dot = path.find_last_of('.');
+        if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+            return path;
+        return path.substr(0, dot);
+    }
+
+    // size of the packaged or loose file
+    static bool fileSize(const std::string &path, uint64_t &size)
+    {
+        AssetBlob packaged;
+        if (AssetPackage::instance().find(path, packaged))
+        {
+            size = packaged.size;
+            return true;
+        }
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return false;
+        size = (uint64_t)info.st_size;
+        return true;
+    }
+
+    // compares two files of the same size. The new one is read again when it is decoded, by then it is in
+    // the OS cache. Packaged files are compared in the mapping.
+    static bool sameContents(const std::string &first, const std::string &second)
+    {
+        std::vector<unsigned char> firstBytes, secondBytes;
+        AssetBlob firstBlob, secondBlob;
+        if (!view(first, firstBlob, firstBytes) || !view(second, secondBlob, secondBytes))
+            return false;
+        return firstBlob.size == secondBlob.size && memcmp(firstBlob.data, secondBlob.data, firstBlob.size) == 0;
+    }
+
+    // the bytes of the file, from the package or read into storage
+    static bool view(const std::string &path, AssetBlob &blob, std::vector<unsigned char> &storage)
+    {
+        if (AssetPackage::instance().find(path, blob))
+            return true;
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        unsigned char chunk[1 << 16];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+            storage.insert(storage.end(), chunk, chunk + read);
+        fclose(file);
+        blob.data = storage.data();
+        blob.size = storage.size();
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <learnopengl/dds.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// CPU block compressor used by the offline tools to turn decoded JPG/PNG images into DDS mip chains.
+// Colors are fitted along the principal axis of each 4x4 block (BC1, and the color half of BC3),
+// single channels use the 8 value interpolated mode (BC4, BC5 and the alpha half of BC3).
+class TextureCompressor
+{
+public:
+    // grey -> BC4, grey+alpha -> BC5, opaque color -> BC1, color with alpha -> BC3
+    static GLenum chooseFormat(const unsigned char *pixels, int width, int height, int channels)
+    {
+        if (channels == 1)
+            return GL_COMPRESSED_RED_RGTC1;
+        if (channels == 2)
+            return GL_COMPRESSED_RG_RGTC2;
+        if (channels == 4)
+        {
+            for (size_t i = 0; i < (size_t)width * height; i++)
+                if (pixels[i * 4 + 3] != 255)
+                    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        }
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+
+    // compresses the image and all its box filtered mip levels down to 1x1
+    static std::vector<std::vector<unsigned char>> compressMipChain(const unsigned char *pixels, int width, int height,
+                                                                    int channels, GLenum format)
+    {
+        std::vector<std::vector<unsigned char>> mips;
+        std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * channels);
+        while (true)
+        {
+            mips.push_back(compress(level.data(), width, height, channels, format));
+            if (width == 1 && height == 1)
+                break;
+            level = downsample(level.data(), width, height, channels);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return mips;
+    }
+
+    static std::vector<unsigned char> compress(const unsigned char *pixels, int width, int height, int channels, GLenum format)
+    {
+        std::vector<unsigned char> blocks;
+        blocks.reserve(DDSImage::levelSize(format, (unsigned int)width, (unsigned int)height));
+        unsigned char block[16][4];
+        for (int by = 0; by < height; by += 4)
+        {
+            for (int bx = 0; bx < width; bx += 4)
+            {
+                // gather the block as RGBA, clamping at the image border
+                for (int i = 0; i < 16; i++)
+                {
+                    int x = std::min(bx + i % 4, width - 1);
+                    int y = std::min(by + i / 4, height - 1);
+                    const unsigned char *p = pixels + ((size_t)y * width + x) * channels;
+                    block[i][0] = p[0];
+                    block[i][1] = channels >= 3 ? p[1] : (channels == 2 ? p[1] : p[0]);
+                    block[i][2] = channels >= 3 ? p[2] : p[0];
+                    block[i][3] = channels == 4 ? p[3] : (channels == 2 ? p[1] : 255);
+                }
+                unsigned char encoded[16];
+                size_t size = DDSImage::blockSize(format);
+                if (format == GL_COMPRESSED_RED_RGTC1)
+                    encodeChannelBlock(block, 0, encoded);
+                else if (format == GL_COMPRESSED_RG_RGTC2)
+                {
+                    encodeChannelBlock(block, 0, encoded);
+                    encodeChannelBlock(block, 3, encoded + 8);
+                }
+                else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+                {
+                    encodeChannelBlock(block, 3, encoded);
+                    encodeColorBlock(block, encoded + 8);
+                }
+                else
+                    encodeColorBlock(block, encoded);
+                blocks.insert(blocks.end(), encoded, encoded + size);
+            }
+        }
+        return blocks;
+    }
+
+    // 2x2 box filter, odd edges are folded into the last texel
+    static std::vector<unsigned char> downsample(const unsigned char *pixels, int width, int height, int channels)
+    {
+        int w = std::max(1, width / 2), h = std::max(1, height / 2);
+        std::vector<unsigned char> result((size_t)w * h * channels);
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+                for (int c = 0; c < channels; c++)
+                {
+                    int sum = pixels[((size_t)y0 * width + x0) * channels + c] + pixels[((size_t)y0 * width + x1) * channels + c]
+                            + pixels[((size_t)y1 * width + x0) * channels + c] + pixels[((size_t)y1 * width + x1) * channels + c];
+                    result[((size_t)y * w + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        return result;
+    }
+
+private:
+    static uint16_t to565(const float color[3])
+    {
+        int r = (int)std::lround(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+        int g = (int)std::lround(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+        int b = (int)std::lround(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+        return (uint16_t)(r << 11 | g << 5 | b);
+    }
+
+    static void from565(uint16_t color, int out[3])
+    {
+        int r = color >> 11 & 31, g = color >> 5 & 63, b = color & 31;
+        out[0] = r << 3 | r >> 2;
+        out[1] = g << 2 | g >> 4;
+        out[2] = b << 3 | b >> 2;
+    }
+
+    // BC1 color block, always in 4 color mode so it can be reused by BC3
+    static void encodeColorBlock(const unsigned char block[16][4], unsigned char out[8])
+    {
+        float mean[3] = {0, 0, 0};
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+                mean[c] += block[i][c] / 16.0f;
+        float cov[6] = {0, 0, 0, 0, 0, 0};
+        for (int i = 0; i < 16; i++)
+        {
+            float d[3] = {block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2]};
+            cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+            cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+        }
+        // principal axis by power iteration
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                             cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                             cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+            float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+            if (length < 1e-6f)
+                break;
+            for (int c = 0; c < 3; c++)
+                axis[c] = next[c] / length;
+        }
+        float minProjection = 1e30f, maxProjection = -1e30f;
+        for (int i = 0; i < 16; i++)
+        {
+            float projection = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+        float high[3], low[3];
+        for (int c = 0; c < 3; c++)
+        {
+            high[c] = mean[c] + axis[c] * maxProjection;
+            low[c] = mean[c] + axis[c] * minProjection;
+        }
+        uint16_t color0 = to565(high), color1 = to565(low);
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        uint32_t indices = 0;
+        if (color0 != color1)
+        {
+            int palette[4][3];
+            from565(color0, palette[0]);
+            from565(color1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestDistance = 1 << 30;
+                for (int p = 0; p < 4; p++)
+                {
+                    int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= (uint32_t)best << (2 * i);
+            }
+        }
+        out[0] = (unsigned char)(color0 & 0xFF); out[1] = (unsigned char)(color0 >> 8);
+        out[2] = (unsigned char)(color1 & 0xFF); out[3] = (unsigned char)(color1 >> 8);
+        for (int i = 0; i < 4; i++)
+            out[4 + i] = (unsigned char)(indices >> (8 * i));
+    }
+
+    // BC4 style block of one channel, endpoints are the channel extremes in 8 value mode
+    static void encodeChannelBlock(const unsigned char block[16][4], int channel, unsigned char out[8])
+    {
+        int high = 0, low = 255;
+        for (int i = 0; i < 16; i++)
+        {
+            high = std::max(high, (int)block[i][channel]);
+            low = std::min(low, (int)block[i][channel]);
+        }
+        uint64_t indices = 0;
+        if (high != low)
+        {
+            int palette[8] = {high, low};
+            for (int p = 1; p < 7; p++)
+                palette[p + 1] = ((7 - p) * high + p * low) / 7;
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestDistance = 1 << 30;
+                for (int p = 0; p < 8; p++)
+                {
+                    int distance = std::abs(block[i][channel] - palette[p]);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= (uint64_t)best << (3 * i);
+            }
+        }
+        out[0] = (unsigned char)high;
+        out[1] = (unsigned char)low;
+        for (int i = 0; i < 6; i++)
+            out[2 + i] = (unsigned char)(indices >> (8 * i));
+    }
+};
+
+#endif
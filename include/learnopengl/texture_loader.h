@@ -0,0 +1,545 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/asset_package.h>
+#include <learnopengl/dds.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/thread_pool.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Asynchronous texture loading: the GL texture name is created (with a 1x1 placeholder image) as soon as a
+// texture is requested, images are decoded by the shared ThreadPool, and processUploads() moves the decoded
+// pixels to the GPU on the GL thread. Callers keep using the returned name, it fills in once uploaded.
+// 2D textures prefer a precompressed .dds with the same name (see tools/texture_compressor.cpp), whose
+// mip chain is uploaded as is instead of decoding the JPG/PNG and building mipmaps at runtime, unless the
+// image was saved after the .dds. Gamma textures upload it with the sRGB variant of its format.
+// Images in the open AssetPackage are read from its mapping, a packaged .dds is uploaded without a copy.
+// Array textures are built from images of any size, a layer of another size is resampled to the array size
+// on the pool.
+// Textures are deleted through deleteTexture(), which waits for the uploads still due and for the GL thread.
+class TextureLoader
+{
+public:
+    static TextureLoader& instance()
+    {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    // 2D texture with mipmaps and repeat wrapping
+    unsigned int load2D(const std::string &path, bool gamma = false)
+    {
+        unsigned int textureID = createPlaceholder(GL_TEXTURE_2D);
+        Job job;
+        job.textureID = textureID;
+        job.bindTarget = GL_TEXTURE_2D;
+        job.imageTarget = GL_TEXTURE_2D;
+        job.path = path;
+        job.gamma = gamma;
+        submit(job);
+        return textureID;
+    }
+
+    // decodes the file of a 2D texture from load2D again and replaces its image once uploaded, the name stays
+    void reload2D(unsigned int textureID, const std::string &path, bool gamma = false)
+    {
+        Job job;
+        job.textureID = textureID;
+        job.bindTarget = GL_TEXTURE_2D;
+        job.imageTarget = GL_TEXTURE_2D;
+        job.path = path;
+        job.gamma = gamma;
+        job.reload = true;
+        submit(job);
+    }
+
+    // cubemap built from six faces in +X, -X, +Y, -Y, +Z, -Z order
+    unsigned int loadCubemap(const std::vector<std::string> &faces)
+    {
+        unsigned int textureID = createPlaceholder(GL_TEXTURE_CUBE_MAP);
+        for (unsigned int i = 0; i < faces.size(); i++)
+        {
+            Job job;
+            job.textureID = textureID;
+            job.bindTarget = GL_TEXTURE_CUBE_MAP;
+            job.imageTarget = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+            job.path = faces[i];
+            job.siblings = (unsigned int)faces.size();
+            submit(job);
+        }
+        return textureID;
+    }
+
+    // RGBA texture array of width x height layers with mipmaps and repeat wrapping, one image per layer.
+    // An empty path leaves its layer black.
+    unsigned int loadArray(const std::vector<std::string> &layers, int width, int height, bool gamma = false)
+    {
+        unsigned int textureID = createPlaceholder(GL_TEXTURE_2D_ARRAY);
+        for (unsigned int i = 0; i < layers.size(); i++)
+        {
+            Job job;
+            job.textureID = textureID;
+            job.bindTarget = GL_TEXTURE_2D_ARRAY;
+            job.layer = i;
+            job.path = layers[i];
+            job.gamma = gamma;
+            job.siblings = (unsigned int)layers.size();
+            job.width = width;
+            job.height = height;
+            submit(job);
+        }
+        return textureID;
+    }
+
+    // uploads decoded images, must be called on the GL thread. Stops after budgetMs milliseconds
+    // (0 = no limit) so a burst of finished decodes does not stall a frame. Returns the number of uploads.
+    unsigned int processUploads(float budgetMs = 4.0f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        unsigned int uploaded = 0;
+        deleteUnused();
+        while (true)
+        {
+            Job job;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (completed.empty())
+                    break;
+                job = completed.front();
+                completed.pop_front();
+            }
+            // the faces of a cubemap and the layers of an array are uploaded together, a partially filled
+            // cubemap would be incomplete and an array needs its storage allocated for all layers at once
+            std::vector<Job> batch;
+            if (job.siblings > 1)
+            {
+                std::vector<Job> &parts = partialTextures[job.textureID];
+                parts.push_back(job);
+                if (parts.size() < job.siblings)
+                    continue;
+                batch.swap(parts);
+                partialTextures.erase(job.textureID);
+            }
+            else
+            {
+                batch.push_back(job);
+            }
+            if (discarded.count(job.textureID))
+            {
+                for (Job &part : batch)
+                    stbi_image_free(part.data);
+            }
+            else if (batch[0].bindTarget == GL_TEXTURE_2D_ARRAY)
+                textureSizes[job.textureID] += uploadArray(batch);
+            else if (batch[0].bindTarget == GL_TEXTURE_CUBE_MAP && !complete(batch))
+            {
+                // an incomplete cubemap samples as black, the placeholder stays instead
+                for (Job &part : batch)
+                {
+                    if (!part.data)
+                        std::cout << "Cubemap texture failed to load at path: " << part.path << std::endl;
+                    stbi_image_free(part.data);
+                }
+            }
+            else
+            {
+                if (job.reload)
+                    textureSizes[job.textureID] = 0;
+                for (Job &part : batch)
+                    textureSizes[job.textureID] += upload(part);
+            }
+            unsigned int &due = unfinished[job.textureID];
+            due -= (unsigned int)batch.size();
+            if (due == 0)
+            {
+                unfinished.erase(job.textureID);
+                if (discarded.erase(job.textureID))
+                    deleteNow(job.textureID);
+            }
+            uploaded += (unsigned int)batch.size();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending -= (unsigned int)batch.size();
+            }
+            idle.notify_all();
+
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (budgetMs > 0.0f && elapsed.count() >= budgetMs)
+                break;
+        }
+        return uploaded;
+    }
+
+    // deletes the texture on the next processUploads(), or once its last upload arrived if it is still loading.
+    // Safe to call when the GL context is already gone, the name is then never deleted.
+    void deleteTexture(unsigned int textureID)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        deleted.push_back(textureID);
+    }
+
+    // estimated GPU memory of the uploaded images of a texture, 0 while it shows the placeholder
+    size_t textureBytes(unsigned int textureID) const
+    {
+        std::map<unsigned int, size_t>::const_iterator size = textureSizes.find(textureID);
+        return size == textureSizes.end() ? 0 : size->second;
+    }
+
+    // blocks the GL thread until every requested texture is decoded and uploaded
+    void finish()
+    {
+        while (true)
+        {
+            processUploads(0.0f);
+            std::unique_lock<std::mutex> lock(mutex);
+            if (pending == 0)
+                return;
+            idle.wait(lock, [this]() { return pending == 0 || !completed.empty(); });
+            if (completed.empty() && decoding == 0)
+                return; // only parts of textures with missing siblings are left
+        }
+    }
+
+    unsigned int pendingCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending;
+    }
+
+private:
+    struct Job {
+        unsigned int textureID = 0;
+        GLenum bindTarget = GL_TEXTURE_2D;
+        GLenum imageTarget = GL_TEXTURE_2D;
+        std::string path;
+        bool gamma = false;
+        // replaces the image of a texture that was uploaded before
+        bool reload = false;
+        unsigned int siblings = 1;
+        unsigned int layer = 0;
+        int width = 0, height = 0, nrComponents = 0;
+        unsigned char *data = nullptr;
+        std::shared_ptr<DDSImage> compressed;
+    };
+
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::deque<Job> completed;
+    std::map<unsigned int, std::vector<Job>> partialTextures;
+    // names passed to deleteTexture, under the mutex
+    std::vector<unsigned int> deleted;
+    // GL thread only: jobs not yet uploaded per texture, deleted textures waiting for them, uploaded bytes
+    std::map<unsigned int, unsigned int> unfinished;
+    std::set<unsigned int> discarded;
+    std::map<unsigned int, size_t> textureSizes;
+    // requested but not yet uploaded / still being decoded on the pool
+    unsigned int pending = 0;
+    unsigned int decoding = 0;
+    std::atomic<bool> stopping{false};
+
+    TextureLoader()
+    {
+        // make sure the pool outlives the loader, jobs still in flight at exit report back to us
+        ThreadPool::shared();
+    }
+
+    ~TextureLoader()
+    {
+        stopping = true;
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return decoding == 0; });
+        for (Job &job : completed)
+            stbi_image_free(job.data);
+        for (auto &parts : partialTextures)
+            for (Job &job : parts.second)
+                stbi_image_free(job.data);
+    }
+
+    void submit(Job job)
+    {
+        unfinished[job.textureID]++;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending++;
+            decoding++;
+        }
+        ThreadPool::shared().enqueue([this, job]() mutable {
+            if (!stopping)
+                decode(job);
+            // notified under the lock: once decoding reaches 0 the destructor may return and destroy the
+            // mutex and the condition variable, the worker must not touch them after unlocking
+            std::lock_guard<std::mutex> lock(mutex);
+            completed.push_back(job);
+            decoding--;
+            idle.notify_all();
+        });
+    }
+
+    void deleteUnused()
+    {
+        std::vector<unsigned int> names;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            names.swap(deleted);
+        }
+        for (unsigned int textureID : names)
+        {
+            if (unfinished.count(textureID))
+                discarded.insert(textureID);
+            else
+                deleteNow(textureID);
+        }
+    }
+
+    void deleteNow(unsigned int textureID)
+    {
+        GLState::instance().deleteTexture(textureID);
+        textureSizes.erase(textureID);
+    }
+
+    // runs on a worker thread
+    static void decode(Job &job)
+    {
+        if (job.bindTarget == GL_TEXTURE_2D_ARRAY)
+        {
+            decodeLayer(job);
+            return;
+        }
+        if (job.bindTarget == GL_TEXTURE_2D)
+        {
+            std::string ddsPath = job.path.substr(0, job.path.find_last_of('.')) + ".dds";
+            AssetBlob packaged;
+            if (AssetPackage::instance().find(ddsPath, packaged))
+            {
+                std::shared_ptr<DDSImage> image = std::make_shared<DDSImage>();
+                if (image->parse(packaged.data, packaged.size, false))
+                {
+                    job.compressed = image;
+                    return;
+                }
+            }
+            // a .dds older than the image was compressed from a previous version of it
+            struct stat info, imageInfo;
+            if (stat(ddsPath.c_str(), &info) == 0
+                && (stat(job.path.c_str(), &imageInfo) != 0 || info.st_mtime >= imageInfo.st_mtime))
+            {
+                std::shared_ptr<DDSImage> image = std::make_shared<DDSImage>();
+                if (image->load(ddsPath))
+                {
+                    job.compressed = image;
+                    return;
+                }
+            }
+        }
+        job.data = loadImage(job.path, &job.width, &job.height, &job.nrComponents, 0);
+    }
+
+    // stbi_load from the package or the file
+    static unsigned char* loadImage(const std::string &path, int *width, int *height, int *components, int desiredComponents)
+    {
+        AssetBlob packaged;
+        if (AssetPackage::instance().find(path, packaged))
+            return stbi_load_from_memory(packaged.data, (int)packaged.size, width, height, components, desiredComponents);
+        return stbi_load(path.c_str(), width, height, components, desiredComponents);
+    }
+
+    // decodes the image as RGBA and resamples it to the array size already in job.width x job.height
+    static void decodeLayer(Job &job)
+    {
+        int width = job.width, height = job.height;
+        job.nrComponents = 4;
+        if (job.path.empty())
+        {
+            // stbi_image_free is free() unless STBI_FREE is overridden
+            job.data = (unsigned char*)calloc((size_t)width * height, 4);
+            return;
+        }
+        int imageWidth, imageHeight, components;
+        unsigned char *image = loadImage(job.path, &imageWidth, &imageHeight, &components, 4);
+        if (!image || (imageWidth == width && imageHeight == height))
+        {
+            job.data = image;
+            return;
+        }
+        job.data = (unsigned char*)malloc((size_t)width * height * 4);
+        resample(image, imageWidth, imageHeight, job.data, width, height);
+        stbi_image_free(image);
+    }
+
+    // bilinear resampling of an RGBA image, good enough for the magnification array layers need
+    static void resample(const unsigned char *source, int sourceWidth, int sourceHeight, unsigned char *target, int width, int height)
+    {
+        float scaleX = (float)sourceWidth / width, scaleY = (float)sourceHeight / height;
+        for (int y = 0; y < height; y++)
+        {
+            float sy = std::min(std::max((y + 0.5f) * scaleY - 0.5f, 0.0f), (float)(sourceHeight - 1));
+            int y0 = (int)sy, y1 = std::min(y0 + 1, sourceHeight - 1);
+            float fy = sy - y0;
+            for (int x = 0; x < width; x++)
+            {
+                float sx = std::min(std::max((x + 0.5f) * scaleX - 0.5f, 0.0f), (float)(sourceWidth - 1));
+                int x0 = (int)sx, x1 = std::min(x0 + 1, sourceWidth - 1);
+                float fx = sx - x0;
+                const unsigned char *p00 = source + ((size_t)y0 * sourceWidth + x0) * 4, *p01 = source + ((size_t)y0 * sourceWidth + x1) * 4;
+                const unsigned char *p10 = source + ((size_t)y1 * sourceWidth + x0) * 4, *p11 = source + ((size_t)y1 * sourceWidth + x1) * 4;
+                unsigned char *out = target + ((size_t)y * width + x) * 4;
+                for (int c = 0; c < 4; c++)
+                {
+                    float top = p00[c] + (p01[c] - p00[c]) * fx;
+                    float bottom = p10[c] + (p11[c] - p10[c]) * fx;
+                    out[c] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+                }
+            }
+        }
+    }
+
+    // true if every image of the batch was decoded
+    static bool complete(const std::vector<Job> &batch)
+    {
+        for (const Job &part : batch)
+            if (!part.data && !part.compressed)
+                return false;
+        return true;
+    }
+
+    static unsigned int createPlaceholder(GLenum target)
+    {
+        static const unsigned char grey[4] = {128, 128, 128, 255};
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        GLState::instance().bindTexture(target, textureID);
+        if (target == GL_TEXTURE_CUBE_MAP)
+        {
+            for (unsigned int i = 0; i < 6; i++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        }
+        else if (target == GL_TEXTURE_2D_ARRAY)
+        {
+            // one layer, lookups of the other layers clamp to it
+            glTexImage3D(target, 0, GL_RGBA, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        }
+        else
+        {
+            glTexImage2D(target, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        }
+        // no mipmaps yet, so the placeholder must not use a mipmapped filter to be complete
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return textureID;
+    }
+
+    // allocates the array for all layers, then fills them in. A layer whose image failed to load is black.
+    // Returns the bytes of all levels.
+    static size_t uploadArray(std::vector<Job> &layers)
+    {
+        const Job &first = layers[0];
+        GLState::instance().bindTexture(GL_TEXTURE_2D_ARRAY, first.textureID);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, first.gamma ? GL_SRGB8_ALPHA8 : GL_RGBA8, first.width, first.height,
+                     (GLsizei)layers.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        std::vector<unsigned char> black;
+        for (Job &layer : layers)
+        {
+            if (!layer.data)
+            {
+                std::cout << "Texture failed to load at path: " << layer.path << std::endl;
+                black.resize((size_t)first.width * first.height * 4, 0);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)layer.layer, first.width, first.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, black.data());
+                continue;
+            }
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)layer.layer, first.width, first.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer.data);
+            stbi_image_free(layer.data);
+            layer.data = nullptr;
+        }
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return (size_t)first.width * first.height * 4 * layers.size() * 4 / 3;
+    }
+
+    // returns the bytes of the image, with its mip chain
+    static size_t upload(Job &job)
+    {
+        if (job.compressed)
+        {
+            const DDSImage::Level &last = job.compressed->levels.back();
+            size_t bytes = last.offset + last.size;
+            GLState::instance().bindTexture(GL_TEXTURE_2D, job.textureID);
+            job.compressed->upload(GL_TEXTURE_2D, job.gamma);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, job.compressed->levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            job.compressed.reset();
+            return bytes;
+        }
+        if (!job.data)
+        {
+            std::cout << "Texture failed to load at path: " << job.path << std::endl;
+            return 0;
+        }
+
+        GLenum format = GL_RED;
+        if (job.nrComponents == 1)
+            format = GL_RED;
+        else if (job.nrComponents == 2)
+            format = GL_RG;
+        else if (job.nrComponents == 3)
+            format = GL_RGB;
+        else if (job.nrComponents == 4)
+            format = GL_RGBA;
+        GLenum internalFormat = format;
+        if (job.gamma && format == GL_RGB)
+            internalFormat = GL_SRGB;
+        else if (job.gamma && format == GL_RGBA)
+            internalFormat = GL_SRGB_ALPHA;
+
+        GLState::instance().bindTexture(job.bindTarget, job.textureID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(job.imageTarget, 0, (GLint)internalFormat, job.width, job.height, 0, format, GL_UNSIGNED_BYTE, job.data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        stbi_image_free(job.data);
+        job.data = nullptr;
+        size_t bytes = (size_t)job.width * job.height * job.nrComponents;
+
+        if (job.bindTarget == GL_TEXTURE_2D)
+        {
+            bytes = bytes * 4 / 3;
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        else
+        {
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        }
+        return bytes;
+    }
+};
+
+#endif
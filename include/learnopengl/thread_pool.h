@@ -0,0 +1,138 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads for CPU work that must stay off the GL thread (image decoding, importing...).
+// Jobs never touch OpenGL, results are handed back to the GL thread by whoever enqueued them.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount)
+    {
+        if (threadCount == 0)
+            threadCount = 1;
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void enqueue(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wakeUp.notify_one();
+    }
+
+    // calls body(begin, end) over [0, count) split into chunks of grain items, on the workers and the calling
+    // thread, and returns once every chunk is done. Workers that only get to run after all chunks were taken
+    // (e.g. because they were busy decoding) just drop out, the caller never waits for them.
+    void parallelFor(size_t count, size_t grain, std::function<void(size_t, size_t)> body)
+    {
+        if (count == 0)
+            return;
+        if (grain == 0)
+            grain = 1;
+        size_t chunkCount = (count + grain - 1) / grain;
+        if (chunkCount == 1)
+        {
+            body(0, count);
+            return;
+        }
+
+        std::shared_ptr<ParallelFor> state = std::make_shared<ParallelFor>();
+        state->count = count;
+        state->grain = grain;
+        state->chunkCount = chunkCount;
+        state->body = std::move(body);
+        size_t helpers = std::min(chunkCount - 1, workers.size());
+        for (size_t i = 0; i < helpers; i++)
+            enqueue([state]() { state->run(); });
+        state->run();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&state]() { return state->finished == state->chunkCount; });
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+    // process wide pool, one worker per core minus the one running the render loop
+    static ThreadPool& shared()
+    {
+        static ThreadPool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1);
+        return pool;
+    }
+
+private:
+    struct ParallelFor {
+        std::atomic<size_t> nextChunk{0};
+        size_t count = 0, grain = 0, chunkCount = 0;
+        std::function<void(size_t, size_t)> body;
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t finished = 0;
+
+        void run()
+        {
+            for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+            {
+                size_t begin = chunk * grain;
+                body(begin, std::min(begin + grain, count));
+                std::lock_guard<std::mutex> lock(mutex);
+                if (++finished == chunkCount)
+                    done.notify_all();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <learnopengl/thread_pool.h>
+
+#include <vector>
+
+// Placement of all instances of one model, stored as structure of arrays so the per-frame update streams
+// through memory. update() rebuilds every model matrix (translate * rotate * spin * scale) in parallel
+// into one contiguous array that can be handed to Model::DrawInstanced as is.
+class InstanceTransforms
+{
+public:
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> orientations;
+    std::vector<float>     scales;
+    // animation, rotation around a local axis
+    std::vector<glm::vec3> spinAxes;
+    std::vector<float>     spinSpeeds; // radians per second
+
+    // output of update()
+    std::vector<glm::mat4> matrices;
+
+    // instances per task, below this the update runs inline on the calling thread
+    static const size_t GRAIN = 2048;
+
+    size_t add(const glm::vec3 &position, const glm::quat &orientation, float scale,
+               const glm::vec3 &spinAxis = glm::vec3(0.0f, 0.0f, 1.0f), float spinSpeed = 0.0f)
+    {
+        positions.push_back(position);
+        orientations.push_back(orientation);
+        scales.push_back(scale);
+        spinAxes.push_back(spinAxis);
+        spinSpeeds.push_back(spinSpeed);
+        matrices.push_back(glm::mat4(1.0f));
+        return positions.size() - 1;
+    }
+
+    size_t size() const
+    {
+        return positions.size();
+    }
+
+    void update(float time, ThreadPool &pool = ThreadPool::shared())
+    {
+        pool.parallelFor(size(), GRAIN, [this, time](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                matrices[i] = compose(i, time);
+        });
+    }
+
+private:
+    glm::mat4 compose(size_t i, float time) const
+    {
+        glm::quat rotation = orientations[i];
+        if (spinSpeeds[i] != 0.0f)
+            rotation = rotation * glm::angleAxis(spinSpeeds[i] * time, spinAxes[i]);
+        glm::mat3 basis = glm::mat3_cast(rotation);
+        float scale = scales[i];
+        glm::mat4 matrix;
+        matrix[0] = glm::vec4(basis[0] * scale, 0.0f);
+        matrix[1] = glm::vec4(basis[1] * scale, 0.0f);
+        matrix[2] = glm::vec4(basis[2] * scale, 0.0f);
+        matrix[3] = glm::vec4(positions[i], 1.0f);
+        return matrix;
+    }
+};
+
+#endif
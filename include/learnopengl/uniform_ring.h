@@ -0,0 +1,236 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <iostream>
+
+// ARB_buffer_storage (core in GL 4.4), not part of the GL 3.3 glad loader
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT   0x0080
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+// Uniform block data of a frame, written once on the CPU and bound by range per draw. The buffer holds FRAMES
+// segments used in turn, a segment is only written again after the fence placed when its frame ended has
+// passed, so the CPU never waits for draws still reading it. With ARB_buffer_storage the buffer is mapped
+// persistently and coherently and write() copies straight into it; without, write() collects the frame in
+// memory and flush() orphans the buffer and uploads everything, which has the driver do the buffering.
+//
+//   ring.beginFrame();
+//   size_t offset = ring.write(&block, sizeof(block));  // any number of blocks
+//   ring.flush();                                       // before the first draw reading them
+//   ring.bind(binding, offset, sizeof(block));
+//
+// Offsets are relative to the frame and valid until the next beginFrame(). A frame that outgrows its segment
+// makes the ring wait for the GPU once and reallocate twice as large, the ranges bound so far are rebound.
+class UniformRing
+{
+public:
+    static const unsigned int FRAMES = 3;
+
+    // loadProc is the loader the GL functions were loaded with, it provides glBufferStorage if the context has it
+    explicit UniformRing(GLADloadproc loadProc, size_t frameSize = 64 * 1024)
+    {
+        GLint offsetAlignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+        alignment = offsetAlignment > 0 ? (size_t)offsetAlignment : 256;
+        if (hasExtension("GL_ARB_buffer_storage"))
+            bufferStorage = (PFNGLBUFFERSTORAGEPROC)loadProc("glBufferStorage");
+        allocate(roundUp(frameSize));
+        if (persistent())
+            std::cout << "UNIFORM_RING:: persistently mapped, " << FRAMES << " x " << segmentSize / 1024 << " KiB" << std::endl;
+        else
+            std::cout << "UNIFORM_RING:: no ARB_buffer_storage, orphaning " << segmentSize / 1024 << " KiB per frame" << std::endl;
+    }
+
+    ~UniformRing()
+    {
+        release();
+    }
+
+    UniformRing(const UniformRing &) = delete;
+    UniformRing& operator=(const UniformRing &) = delete;
+
+    bool persistent() const
+    {
+        return mapping != nullptr;
+    }
+
+    // ends the previous frame and starts writing the next segment
+    void beginFrame()
+    {
+        if (persistent())
+        {
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            frame = (frame + 1) % FRAMES;
+            wait(frame);
+        }
+        used = 0;
+        bindings.clear();
+    }
+
+    // copies a block into the frame's segment and returns its offset
+    size_t write(const void *data, size_t size)
+    {
+        size_t offset = roundUp(used);
+        if (offset + size > segmentSize)
+            grow(offset + size);
+        std::memcpy(frameData() + offset, data, size);
+        used = offset + size;
+        return offset;
+    }
+
+    // makes the blocks written so far visible to GL, a persistent mapping is coherent and needs nothing
+    void flush()
+    {
+        if (persistent() || used == 0)
+            return;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, segmentSize, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, used, staging.data());
+    }
+
+    // binds size bytes at the offset write() returned to a uniform block binding point
+    void bind(GLuint binding, size_t offset, size_t size)
+    {
+        bindings.push_back(Binding{binding, offset, size});
+        GLState::instance().bindUniformBuffer(binding, buffer, (GLintptr)(frameBase() + offset), (GLsizeiptr)size);
+    }
+
+    // bytes written this frame
+    size_t size() const
+    {
+        return used;
+    }
+
+    // deletes the buffer and the fences, must be called while the context is still current (the destructor
+    // does it too, for rings that go away before the context)
+    void release()
+    {
+        for (GLsync &fence : fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if (mapping)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            mapping = nullptr;
+        }
+        if (buffer)
+            GLState::instance().deleteBuffer(buffer);
+        buffer = 0;
+    }
+
+private:
+    struct Binding {
+        GLuint binding;
+        size_t offset, size;
+    };
+
+    PFNGLBUFFERSTORAGEPROC bufferStorage = nullptr;
+    GLuint buffer = 0;
+    unsigned char *mapping = nullptr;
+    std::vector<unsigned char> staging;
+    size_t segmentSize = 0, alignment = 256, used = 0;
+    unsigned int frame = 0;
+    GLsync fences[FRAMES] = {};
+    // ranges bound this frame, rebound if the buffer is replaced
+    std::vector<Binding> bindings;
+
+    size_t roundUp(size_t size) const
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    size_t frameBase() const
+    {
+        return persistent() ? frame * segmentSize : 0;
+    }
+
+    unsigned char* frameData()
+    {
+        return persistent() ? mapping + frameBase() : staging.data();
+    }
+
+    void allocate(size_t size)
+    {
+        segmentSize = size;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if (bufferStorage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(GL_UNIFORM_BUFFER, FRAMES * segmentSize, nullptr, flags);
+            mapping = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, FRAMES * segmentSize, flags);
+            if (mapping)
+                return;
+            // storage is immutable, start over with a buffer that can be orphaned
+            bufferStorage = nullptr;
+            GLState::instance().deleteBuffer(buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        }
+        staging.resize(segmentSize);
+        glBufferData(GL_UNIFORM_BUFFER, segmentSize, nullptr, GL_STREAM_DRAW);
+    }
+
+    // waits until the GPU is done with the draws of the frame that last used segment
+    void wait(unsigned int segment)
+    {
+        if (!fences[segment])
+            return;
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (glClientWaitSync(fences[segment], flags, 1000000000) == GL_TIMEOUT_EXPIRED)
+            flags = 0;
+        glDeleteSync(fences[segment]);
+        fences[segment] = nullptr;
+    }
+
+    // replaces the buffer with one whose segments hold at least size bytes, keeping the frame's blocks
+    void grow(size_t size)
+    {
+        size_t grown = roundUp(std::max(size, 2 * segmentSize));
+        if (!persistent())
+        {
+            segmentSize = grown;
+            staging.resize(segmentSize);
+            return;
+        }
+        std::vector<unsigned char> written(frameData(), frameData() + used);
+        // every segment may be in use, simplest to let the GPU finish
+        glFinish();
+        release();
+        allocate(grown);
+        std::memcpy(frameData(), written.data(), written.size());
+        std::vector<Binding> rebound;
+        rebound.swap(bindings);
+        for (const Binding &binding : rebound)
+            bind(binding.binding, binding.offset, binding.size);
+        std::cout << "UNIFORM_RING:: grown to " << FRAMES << " x " << segmentSize / 1024 << " KiB" << std::endl;
+    }
+
+    static bool hasExtension(const char *name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+            if (extension && std::strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif
@@ -13,8 +13,40 @@
 #include <rg/Error.h>
 #include <common.h>
 #include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
 class Shader {
     unsigned int m_Id;
+    // name -> location of every active uniform, read once after linking
+    mutable std::unordered_map<std::string, int> m_UniformLocations;
+
+    void cacheUniformLocations() {
+        m_UniformLocations.clear();
+        int count = 0, maxLength = 0;
+        glGetProgramiv(m_Id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(m_Id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> buffer(maxLength > 0 ? maxLength : 1);
+        for (int i = 0; i < count; ++i) {
+            int length = 0, size = 0;
+            GLenum type;
+            glGetActiveUniform(m_Id, i, (int)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            int location = glGetUniformLocation(m_Id, name.c_str());
+            if (location < 0) {
+                continue;
+            }
+            m_UniformLocations[name] = location;
+            // arrays are reported as "name[0]"
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+                std::string base = name.substr(0, name.size() - 3);
+                m_UniformLocations[base] = location;
+                for (int element = 1; element < size; ++element) {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    m_UniformLocations[elementName] = glGetUniformLocation(m_Id, elementName.c_str());
+                }
+            }
+        }
+    }
 public:
     Shader(std::string vertexShaderPath, std::string fragmentShaderPath) {
         appendShaderFolderIfNotPresent(vertexShaderPath);
@@ -65,6 +97,18 @@ public:
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
         m_Id = shaderProgram;
+        cacheUniformLocations();
+    }
+
+    // cached location of a uniform, pass it to the setters instead of the name in the render loop
+    int getUniformLocation(const std::string &name) const {
+        auto it = m_UniformLocations.find(name);
+        if (it != m_UniformLocations.end()) {
+            return it->second;
+        }
+        int location = glGetUniformLocation(m_Id, name.c_str());
+        m_UniformLocations.emplace(name, location);
+        return location;
     }
 
     // activate the shader
@@ -77,59 +121,79 @@ public:
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(m_Id, name.c_str()), (int)value);
+        glUniform1i(getUniformLocation(name), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     {
-        glUniform1i(glGetUniformLocation(m_Id, name.c_str()), value);
+        glUniform1i(getUniformLocation(name), value);
+    }
+    void setInt(int location, int value) const
+    {
+        glUniform1i(location, value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     {
-        glUniform1f(glGetUniformLocation(m_Id, name.c_str()), value);
+        glUniform1f(getUniformLocation(name), value);
+    }
+    void setFloat(int location, float value) const
+    {
+        glUniform1f(location, value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(m_Id, name.c_str()), 1, &value[0]);
+        glUniform2fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec2(const std::string &name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(m_Id, name.c_str()), x, y);
+        glUniform2f(getUniformLocation(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(m_Id, name.c_str()), 1, &value[0]);
+        glUniform3fv(getUniformLocation(name), 1, &value[0]);
+    }
+    void setVec3(int location, const glm::vec3 &value) const
+    {
+        glUniform3fv(location, 1, &value[0]);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(m_Id, name.c_str()), x, y, z);
+        glUniform3f(getUniformLocation(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(m_Id, name.c_str()), 1, &value[0]);
+        glUniform4fv(getUniformLocation(name), 1, &value[0]);
+    }
+    void setVec4(int location, const glm::vec4 &value) const
+    {
+        glUniform4fv(location, 1, &value[0]);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(m_Id, name.c_str()), x, y, z, w);
+        glUniform4f(getUniformLocation(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(m_Id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(m_Id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(m_Id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(int location, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
     }
     void deleteProgram() {
         glDeleteProgram(m_Id);
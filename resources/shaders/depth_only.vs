@@ -0,0 +1,36 @@
+#version 330 core
+layout (location = 0) in vec4 aPos;
+#ifdef INSTANCED
+layout (location = 5) in mat4 aInstanceModel;
+#endif
+
+// per frame, see CameraBlock in main.cpp
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+// per draw, see DrawBlock in render_queue.h; model is unused by instanced draws
+layout (std140) uniform Draw {
+    mat4 model;
+    vec3 posScale;
+    bool packedVertex;
+    vec3 posOffset;
+    bool textureArrays;
+};
+
+// depth pre-pass, see RenderQueue. gl_Position is computed exactly like in scene_light.vs and
+// scene_light_instanced.vs, the scene pass tests the depths for equality.
+invariant gl_Position;
+
+void main()
+{
+    vec3 position = packedVertex ? aPos.xyz * posScale + posOffset : aPos.xyz;
+#ifdef INSTANCED
+    vec3 FragPos = vec3(aInstanceModel * vec4(position, 1.0));
+#else
+    vec3 FragPos = vec3(model * vec4(position, 1.0));
+#endif
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
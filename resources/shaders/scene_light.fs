@@ -39,6 +39,9 @@ struct SpotLight {
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
+    // maps of meshes drawn from texture arrays, see Model::loadTextureArrays
+    sampler2DArray texture_diffuse_array;
+    sampler2DArray texture_specular_array;
 
     float shininess;
 };
@@ -46,29 +49,81 @@ struct Material {
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
+flat in int TextureLayer;
+
+// blocks shared with scene_light.vs, see main.cpp and render_queue.h
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+layout (std140) uniform Draw {
+    mat4 model;
+    vec3 posScale;
+    bool packedVertex;
+    vec3 posOffset;
+    bool textureArrays;
+};
+
+// per frame, see LightsBlock in main.cpp. The blinn and flashlight switches are compile time features of the
+// program instead (BLINN, FLASH_LIGHT), see ShaderPermutations
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLight;
+    SpotLight spotLight;
+};
+
+// clustered point lights, see light_clusters.h
+layout (std140) uniform Clusters {
+    vec2 tileScale;     // clusters per pixel
+    float sliceScale;   // slice = log(view depth) * sliceScale + sliceBias
+    float sliceBias;
+    ivec3 clusterCount;
+    int clusterLightCount;
+};
+uniform samplerBuffer clusterLights;   // position and radius, color
+uniform usamplerBuffer clusterGrid;    // first index and light count of every cluster
+uniform usamplerBuffer clusterIndices;
 
-uniform DirLight dirLight;
-uniform PointLight pointLight;
-uniform SpotLight spotLight;
 uniform Material material;
-uniform bool blinn;
-uniform bool flashLight;
 
-uniform vec3 viewPosition;
+// material colors at this fragment, sampled once in main
+vec3 diffuseColor;
+vec3 specularColor;
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcClusterLights(vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main()
 {
+#ifdef OVERDRAW
+    // overdraw view: every shaded fragment adds the same amount with additive blending (see main.cpp), so the
+    // brightness of a pixel counts how often it was shaded
+    FragColor = vec4(0.08, 0.04, 0.015, 1.0);
+    return;
+#endif
+    if (textureArrays) {
+        vec3 coords = vec3(TexCoords, float(TextureLayer));
+        diffuseColor = texture(material.texture_diffuse_array, coords).rgb;
+        specularColor = texture(material.texture_specular_array, coords).rgb;
+    } else {
+        diffuseColor = texture(material.texture_diffuse1, TexCoords).rgb;
+        specularColor = texture(material.texture_specular1, TexCoords).rgb;
+    }
+
     vec3 normal = normalize(Normal);
     vec3 viewDir = normalize(viewPosition - FragPos);
     vec3 result = CalcDirLight(dirLight, normal, viewDir);
     result += CalcPointLight(pointLight, normal, FragPos, viewDir);
 
-    if (flashLight)
-        result += CalcSpotLight(spotLight, normal, FragPos, viewDir);
+#ifdef FLASH_LIGHT
+    result += CalcSpotLight(spotLight, normal, FragPos, viewDir);
+#endif
+    if (clusterLightCount > 0)
+        result += CalcClusterLights(normal, FragPos, viewDir);
     FragColor = vec4(result, 1.0);
 }
 
@@ -81,18 +136,17 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
 
-    float spec = 0.0f;
-    if (blinn) {
-        vec3 halfwayDir = normalize(lightDir + viewDir);
-        spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    } else {
-            spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    }
+#ifdef BLINN
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+#else
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+#endif
 
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     return (ambient + diffuse + specular);
 }
 
@@ -105,21 +159,20 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
 
-    float spec = 0.0f;
-    if (blinn) {
-        vec3 halfwayDir = normalize(lightDir + viewDir);
-        spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    } else {
-        spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    }
+#ifdef BLINN
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+#else
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+#endif
 
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).xxx);
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor.xxx;
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -134,13 +187,12 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = 0.0f;
-    if (blinn) {
-        vec3 halfwayDir = normalize(lightDir + viewDir);
-        spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    } else {
-        spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    }
+#ifdef BLINN
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+#else
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+#endif
 
     // attenuation
     float distance = length(light.position - fragPos);
@@ -150,11 +202,46 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
     return (ambient + diffuse + specular);
-}
\ No newline at end of file
+}
+
+// calculates the color with the point lights of the fragment's cluster.
+vec3 CalcClusterLights(vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int slice = clamp(int(log(depth) * sliceScale + sliceBias), 0, clusterCount.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy * tileScale), ivec2(0), clusterCount.xy - 1);
+    uvec2 range = texelFetch(clusterGrid, (slice * clusterCount.y + tile.y) * clusterCount.x + tile.x).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, 2 * light);
+        vec3 color = texelFetch(clusterLights, 2 * light + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - fragPos;
+        float distance = length(toLight);
+        vec3 lightDir = toLight / distance;
+        // diffuse shading
+        float diff = max(dot(normal, lightDir), 0.0);
+        // specular shading
+#ifdef BLINN
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+#else
+        float spec = pow(max(dot(viewDir, reflect(-lightDir, normal)), 0.0), material.shininess);
+#endif
+
+        // inverse square falloff that reaches zero at the radius, so the light never leaves its clusters
+        float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (1.0 + distance * distance);
+        result += color * (diff * diffuseColor + spec * specularColor) * attenuation;
+    }
+    return result;
+}
@@ -1,20 +1,48 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
+flat out int TextureLayer;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per frame, see CameraBlock in main.cpp
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+// per draw, see DrawBlock in render_queue.h. Meshes uploaded as PackedVertex (see mesh.h): position quantized
+// inside the mesh bounds, octahedral encoded normal in aNormal.xy, tangent handedness in bit 0 of aPos.w and the
+// texture array layer above it
+layout (std140) uniform Draw {
+    mat4 model;
+    vec3 posScale;
+    bool packedVertex;
+    vec3 posOffset;
+    bool textureArrays;
+};
+
+// the depth pre-pass (depth_only.vs) leaves the same depths, this pass tests them with GL_EQUAL
+invariant gl_Position;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = aNormal;
+    vec3 position = packedVertex ? aPos.xyz * posScale + posOffset : aPos.xyz;
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = packedVertex ? octDecode(aNormal.xy) : aNormal;
     TexCoords = aTexCoords;    
+    TextureLayer = packedVertex ? int(aPos.w * 65535.0 + 0.5) >> 1 : 0;
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
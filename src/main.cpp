@@ -6,12 +6,36 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <imgui.h>
+#include <imgui_impl_glfw.h>
+#include <imgui_impl_opengl3.h>
+
+#include <learnopengl/asset_package.h>
+#include <learnopengl/benchmark.h>
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/shader_permutations.h>
 #include <learnopengl/camera.h>
+#include <learnopengl/file_watcher.h>
+#include <learnopengl/frustum.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/light_clusters.h>
 #include <learnopengl/model.h>
-
+#include <learnopengl/model_loader.h>
+#include <learnopengl/profiler.h>
+#include <learnopengl/program_cache.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/render_stats.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/texture_loader.h>
+#include <learnopengl/transforms.h>
+#include <learnopengl/uniform_ring.h>
+
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
@@ -20,6 +44,62 @@ void processInput(GLFWwindow *window);
 unsigned int loadCubemap(vector<std::string> faces);
 unsigned int loadTexture(char const * path);
 
+// std140 mirrors of the per-frame uniform blocks of the scene_light shaders, the Draw block is RenderQueue's
+struct CameraBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPosition;
+    float padding;
+};
+struct LightsBlock {
+    struct {
+        glm::vec3 direction; float padding0;
+        glm::vec3 ambient;   float padding1;
+        glm::vec3 diffuse;   float padding2;
+        glm::vec3 specular;  float padding3;
+    } dirLight;
+    struct {
+        glm::vec3 position; float padding0;
+        glm::vec3 specular; float padding1;
+        glm::vec3 diffuse;  float padding2;
+        glm::vec3 ambient;
+        float constant, linear, quadratic, padding3[2];
+    } pointLight;
+    struct {
+        glm::vec3 position; float padding0;
+        glm::vec3 direction;
+        float cutOff, outerCutOff, constant, linear, quadratic;
+        glm::vec3 ambient;  float padding1;
+        glm::vec3 diffuse;  float padding2;
+        glm::vec3 specular; float padding3;
+    } spotLight;
+};
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint LIGHTS_BLOCK_BINDING = 1;
+// compile time features of the scene_light programs, toggled with B and F; O replaces the lighting with the
+// overdraw view
+const std::vector<std::string> SCENE_LIGHT_FEATURES = {"BLINN", "FLASH_LIGHT", "OVERDRAW"};
+enum SceneLightFeature {
+    FEATURE_BLINN = 1 << 0,
+    FEATURE_FLASH_LIGHT = 1 << 1,
+    FEATURE_OVERDRAW = 1 << 2
+};
+// the depth_only program of instanced draws
+const unsigned int DEPTH_ONLY_INSTANCED = 1 << 0;
+
+void setSceneLightConstants(Shader &shader);
+void setDepthOnlyConstants(Shader &shader);
+unsigned int sceneLightFeatures();
+LightsBlock sceneLights();
+void writeSceneFrame(UniformRing &ring, LightsBlock &lights, const glm::mat4 &projection, const glm::mat4 &view);
+
+// laser bolt flying from one point to another over and over, a clustered point light
+struct LaserBolt {
+    glm::vec3 from, to;
+    float phase, speed;
+    glm::vec3 color;
+};
+
 // settings
 const unsigned int SCR_WIDTH = 1920;
 const unsigned int SCR_HEIGHT = 1080;
@@ -28,6 +108,17 @@ bool blinnKeyPressed = false;
 bool flashLight = false;
 bool flashLightKeyPressed = false;
 bool faceCullingKeyPressed = false;
+bool depthPrePass = false;
+bool depthPrePassKeyPressed = false;
+bool overdrawView = false;
+bool overdrawKeyPressed = false;
+bool showProfiler = false;
+bool profilerKeyPressed = false;
+bool writeTrace = false;
+bool traceKeyPressed = false;
+// framebuffer size in pixels, the clustered lights are found by pixel position
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 30.0f));
@@ -43,9 +134,46 @@ float cubeMoveLR = 0.0f;
 float cubeMoveUD = 0.0f;
 float cubeRotate = 0.0f;
 
-int main() {
+int main(int argc, char **argv) {
+    // command line: --fleet N adds N procedurally placed bombers to the scene
+    //               --bench [N] renders N frames (default 1000) offscreen along a fixed camera path and prints timings as JSON
+    //               --bench-output FILE also writes the benchmark JSON to FILE
+    //               --trace FILE writes a Chrome trace of the last frames to FILE on exit
+    //               --package FILE reads assets from the package built by asset_packer, loose files are the fallback
+    //               --lasers N number of laser bolts lighting the fleets (default 64)
+    //               --depth-prepass starts with the depth pre-pass turned on (toggled with P)
+    unsigned int extraBombers = 0;
+    unsigned int laserCount = 64;
+    unsigned int benchmarkFrames = 0;
+    std::string benchmarkOutput;
+    std::string traceOutput;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--fleet" && i + 1 < argc)
+            extraBombers = (unsigned int) std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--bench") {
+            benchmarkFrames = 1000;
+            if (i + 1 < argc && isdigit((unsigned char) argv[i + 1][0]))
+                benchmarkFrames = std::max(1u, (unsigned int) std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--bench-output" && i + 1 < argc)
+            benchmarkOutput = argv[++i];
+        else if (arg == "--depth-prepass")
+            depthPrePass = true;
+        else if (arg == "--lasers" && i + 1 < argc)
+            laserCount = (unsigned int) std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--trace" && i + 1 < argc)
+            traceOutput = argv[++i];
+        else if (arg == "--package" && i + 1 < argc) {
+            if (AssetPackage::instance().open(argv[++i], FileSystem::getPath("")))
+                std::cout << "Asset package " << argv[i] << " holds " << AssetPackage::instance().fileCount() << " files" << std::endl;
+        }
+    }
+    Benchmark bench(benchmarkFrames, SCR_WIDTH, SCR_HEIGHT);
+
     // glfw: initialize and configure
     // ------------------------------
+    bench.initHints();
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -57,7 +185,8 @@ int main() {
 
     // glfw window creation
     // --------------------
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Star Wars", NULL, NULL);
+    GLFWwindow *window = bench.enabled() ? bench.createWindow("Star Wars")
+                                         : glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Star Wars", NULL, NULL);
     if (window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -67,9 +196,11 @@ int main() {
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
 
     // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (!bench.enabled())
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
@@ -77,22 +208,63 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    // programs linked on an earlier start are loaded as driver binaries instead of compiled
+    ProgramCache::instance().init((GLADloadproc) glfwGetProcAddress);
+
+    // profiler overlay, F1 shows it and F2 writes a Chrome trace
+    if (!bench.enabled()) {
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGui::GetIO().IniFilename = NULL;
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init("#version 330 core");
+    }
+    Profiler profiler;
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
 //    stbi_set_flip_vertically_on_load(true);
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    GLState &glState = GLState::instance();
+    glState.enable(GL_DEPTH_TEST);
+
+    // per-frame and per-draw uniform blocks
+    UniformRing uniformRing((GLADloadproc) glfwGetProcAddress);
+    // engine glows and laser bolts, binned into view space clusters every frame
+    LightClusters lightClusters;
 
     // Face culling
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
+    glState.enable(GL_CULL_FACE);
+    glState.cullFace(GL_BACK);
 
     // build and compile shaders
     // -------------------------
+    auto shadersStart = std::chrono::steady_clock::now();
     Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
-    Shader sceneLight("resources/shaders/scene_light.vs", "resources/shaders/scene_light.fs");
+    // one program per combination of features, the material and the block bindings are set in each when it is
+    // built and keep their values
+    ShaderPermutations sceneLight("resources/shaders/scene_light.vs", "resources/shaders/scene_light.fs",
+                                  SCENE_LIGHT_FEATURES, setSceneLightConstants);
+    ShaderPermutations sceneLightInstanced("resources/shaders/scene_light_instanced.vs", "resources/shaders/scene_light.fs",
+                                           SCENE_LIGHT_FEATURES, setSceneLightConstants);
+    // all lighting combinations now, toggling a feature must not stall a frame on compiling. The overdraw view
+    // is compiled when it is first turned on.
+    sceneLight.compileAll(FEATURE_BLINN | FEATURE_FLASH_LIGHT);
+    sceneLightInstanced.compileAll(FEATURE_BLINN | FEATURE_FLASH_LIGHT);
+    // positions only, for the depth pre-pass
+    ShaderPermutations depthOnly("resources/shaders/depth_only.vs", "resources/shaders/depth_only.fs", {"INSTANCED"},
+                                 setDepthOnlyConstants);
+    depthOnly.compileAll();
+    double shadersMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shadersStart).count();
+    const ProgramCache::Stats &programStats = ProgramCache::instance().stats();
+    std::cout << "Shaders ready in " << shadersMs << " ms: " << programStats.compiled << " programs compiled in "
+              << programStats.compileMs << " ms, " << programStats.loaded << " loaded from the binary cache in "
+              << programStats.loadMs << " ms instead of " << programStats.savedMs << " ms" << std::endl;
+    bench.recordStartup("shaders", shadersMs);
+    bench.recordStartup("shader_compile", programStats.compileMs);
+    bench.recordStartup("shader_cache_load", programStats.loadMs);
+    bench.recordStartup("shader_cache_saved", programStats.savedMs - programStats.loadMs);
     Shader swCube("resources/shaders/cube_discard.vs", "resources/shaders/cube_discard.fs");
 
     // star wars cube coordinates
@@ -230,7 +402,7 @@ int main() {
     glGenVertexArrays(1, &swcubeVAO);
     glGenBuffers(1, &swcubeVBO);
 
-    glBindVertexArray(swcubeVAO);
+    glState.bindVertexArray(swcubeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, swcubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
@@ -246,7 +418,7 @@ int main() {
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
 
-    glBindVertexArray(skyboxVAO);
+    glState.bindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
 
@@ -272,195 +444,325 @@ int main() {
 
     // load models
     // -----------
-    Model bomber("resources/objects/sw_bomber/tieBomber.obj");
-    bomber.SetShaderTextureNamePrefix("material.");
-
-    Model milleniumFalcon("resources/objects/sw_millenium_falcon/Halcon_Milenario.obj");
-    milleniumFalcon.SetShaderTextureNamePrefix("material.");
+    // the models are read on the worker threads and show up as soon as they are uploaded, the first frames
+    // are drawn without them
+    ModelLoader &modelLoader = ModelLoader::instance();
+    std::shared_ptr<Model> bomber = modelLoader.request("resources/objects/sw_bomber/tieBomber.obj");
+    bomber->SetShaderTextureNamePrefix("material.");
+
+    std::shared_ptr<Model> milleniumFalcon = modelLoader.request("resources/objects/sw_millenium_falcon/Halcon_Milenario.obj");
+    milleniumFalcon->SetShaderTextureNamePrefix("material.");
+
+    std::shared_ptr<Model> tieFighter = modelLoader.request("resources/objects/sw_fighter/tie_fighter.obj");
+    tieFighter->SetShaderTextureNamePrefix("material.");
+    tieFighter->twoSided = true;
+
+    std::shared_ptr<Model> deathStar = modelLoader.request("resources/objects/sw_death_star/DeathStar.obj");
+    deathStar->SetShaderTextureNamePrefix("material.");
+
+    std::shared_ptr<Model> starDestroyer = modelLoader.request("resources/objects/sw_star_destroyer/star_destroyer.obj");
+    starDestroyer->SetShaderTextureNamePrefix("material.");
+
+    std::shared_ptr<Model> xWingStarFighter = modelLoader.request("resources/objects/sw_x_wing/x-wing-flyingv1.obj");
+    xWingStarFighter->SetShaderTextureNamePrefix("material.");
+
+    const std::shared_ptr<Model> models[] = {bomber, milleniumFalcon, tieFighter, deathStar, starDestroyer, xWingStarFighter};
+    bool modelsReported = false;
+    auto reportModels = [&models]() {
+        // textures keep decoding on the worker threads while the first frames are drawn
+        std::cout << "Models loaded, " << TextureLoader::instance().pendingCount() << " textures still decoding" << std::endl;
+        size_t geometryBytes = 0;
+        for (const std::shared_ptr<Model> &model : models)
+            geometryBytes += model->GpuBytes();
+        std::cout << "Model geometry uses " << geometryBytes / 1024 << " KiB of GPU memory" << std::endl;
+        TextureCache::Stats textureStats = TextureCache::instance().stats();
+        std::cout << textureStats.textures << " textures for " << textureStats.references << " references, "
+                  << textureStats.pathHits << " found by path and " << textureStats.contentHits << " by content" << std::endl;
+    };
 
-    Model tieFighter("resources/objects/sw_fighter/tie_fighter.obj");
-    tieFighter.SetShaderTextureNamePrefix("material.");
+    // hot reload: shaders, models and textures saved while the program runs are loaded again, the new version
+    // replaces the old one between two frames. The benchmark always renders what it started with.
+    FileWatcher fileWatcher;
+    if (!bench.enabled()) {
+        fileWatcher.watch("resources/shaders");
+        for (const std::shared_ptr<Model> &model : models)
+            fileWatcher.watch(model->directory);
+    }
+    ShaderPermutations *const reloadableShaders[] = {&sceneLight, &sceneLightInstanced, &depthOnly};
+    auto reloadChanged = [&]() {
+        for (const std::string &path : fileWatcher.changes()) {
+            bool shader = false;
+            for (ShaderPermutations *permutations : reloadableShaders) {
+                if (!permutations->uses(path))
+                    continue;
+                shader = true;
+                if (permutations->reload())
+                    std::cout << "Reloaded " << permutations->size() << " programs using " << path << std::endl;
+                else
+                    std::cout << "Keeping the previous programs using " << path << std::endl;
+            }
+            if (shader)
+                continue;
+            std::string extension = path.substr(path.find_last_of('.') + 1);
+            for (char &c : extension)
+                c = (char) std::tolower((unsigned char) c);
+            bool image = extension == "jpg" || extension == "jpeg" || extension == "png" || extension == "tga"
+                         || extension == "bmp" || extension == "dds";
+            if (image && TextureCache::instance().reload(path) > 0) {
+                std::cout << "Reloading texture " << path << std::endl;
+                continue;
+            }
+            // an image packed into a model's texture arrays, or the model or its materials; anything but an
+            // image bypasses the mesh cache, which doesn't know about material files
+            for (const std::shared_ptr<Model> &model : models) {
+                if (path.compare(0, model->directory.size() + 1, model->directory + '/') != 0)
+                    continue;
+                std::cout << "Reloading model " << model->directory << " for " << path << std::endl;
+                modelLoader.reload(model, !image);
+            }
+        }
+    };
 
-    Model deathStar("resources/objects/sw_death_star/DeathStar.obj");
-    deathStar.SetShaderTextureNamePrefix("material.");
+    // the lights are written to the ring with the camera every frame, the spot light follows it
+    LightsBlock lights = sceneLights();
+
+    // handles of the uniforms that change every frame
+    const GLint cubeProjection = swCube.getUniformLocation("projection");
+    const GLint cubeView = swCube.getUniformLocation("view");
+    const GLint cubeModel = swCube.getUniformLocation("model");
+    const GLint skyboxProjection = skyboxShader.getUniformLocation("projection");
+    const GLint skyboxView = skyboxShader.getUniformLocation("view");
+
+    // fleet placement, the model matrices are rebuilt every frame on all cores
+    const glm::vec3 xAxis(1.0f, 0.0f, 0.0f), yAxis(0.0f, 1.0f, 0.0f), zAxis(0.0f, 0.0f, 1.0f);
+    InstanceTransforms bombers, fighters, destroyers, xWings;
+    for (unsigned int i = 0 ; i < 11 ; i++)
+        bombers.add(bomberPositions[i], glm::angleAxis(glm::radians(25.0f), xAxis), 0.85f, zAxis, 1.0f);
+    std::mt19937 fleetRandom(1977);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (unsigned int i = 0 ; i < extraBombers ; i++) {
+        glm::vec3 position(600.0f * unit(fleetRandom) - 300.0f, 300.0f * unit(fleetRandom) - 150.0f, -40.0f - 860.0f * unit(fleetRandom));
+        bombers.add(position, glm::angleAxis(glm::radians(25.0f), xAxis), 0.85f, zAxis, 0.5f + unit(fleetRandom));
+    }
+    for (unsigned int i = 0 ; i < 5 ; i++)
+        fighters.add(fighterPositions[i], glm::angleAxis(glm::radians(-90.0f), yAxis) * glm::angleAxis(glm::radians(-25.0f), zAxis), 0.05f);
+    const float destroyerYaw[] = {180.0f, 180.0f - 25.0f, 180.0f + 35.0f};
+    for (unsigned int i = 0 ; i < 3 ; i++)
+        destroyers.add(destroyerPositions[i], glm::angleAxis(glm::radians(destroyerYaw[i]), yAxis), 0.6f);
+    // x wing star fighter objekti su kompleksniji i njihovo ucitavanje traje duze, zato se modeli ucitavaju
+    // u pozadini i prozor ne zamrzava dok se ne ucitaju
+    for (unsigned int i = 0 ; i < 3 ; i++)
+        xWings.add(xWingPositions[i], glm::angleAxis(glm::radians(15.0f), xAxis), 0.35f);
+
+    // laser bolts between the rebels and the imperial fleet, red from the x-wings and green from the empire
+    vector<LaserBolt> laserBolts;
+    for (unsigned int i = 0 ; i < laserCount ; i++) {
+        bool rebel = i % 2 == 0;
+        glm::vec3 rebels = xWingPositions[i / 2 % 3] + glm::vec3(10.0f * unit(fleetRandom) - 5.0f, 10.0f * unit(fleetRandom) - 5.0f, 0.0f);
+        glm::vec3 empire = bomberPositions[i / 2 % 11] + glm::vec3(20.0f * unit(fleetRandom) - 10.0f, 20.0f * unit(fleetRandom) - 10.0f, 0.0f);
+        laserBolts.push_back({rebel ? rebels : empire, rebel ? empire : rebels, unit(fleetRandom), 0.2f + 0.3f * unit(fleetRandom),
+                              rebel ? glm::vec3(4.0f, 0.3f, 0.2f) : glm::vec3(0.3f, 4.0f, 0.4f)});
+    }
 
-    Model starDestroyer("resources/objects/sw_star_destroyer/star_destroyer.obj");
-    starDestroyer.SetShaderTextureNamePrefix("material.");
+    // the benchmark measures rendering only, so it waits for every model and texture before the first frame
+    if (bench.enabled()) {
+        auto assetsStart = std::chrono::steady_clock::now();
+        modelLoader.finish();
+        TextureLoader::instance().finish();
+        bench.recordStartup("assets", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - assetsStart).count());
+        bench.begin();
+    }
 
-    Model xWingStarFighter("resources/objects/sw_x_wing/x-wing-flyingv1.obj");
-    xWingStarFighter.SetShaderTextureNamePrefix("material.");
+    // draws of the models, sorted before they are executed every frame
+    RenderQueue renderQueue;
+    // detail levels of the models drawn one at a time, kept between frames
+    LodState milleniumFalconLod, deathStarLod;
 
     // draw in wireframe
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window)) {
+    while (!glfwWindowShouldClose(window) && (!bench.enabled() || bench.running())) {
+        RenderStats::frame().reset();
+        profiler.beginFrame();
+
         // per-frame time logic
         // --------------------
-        float currentFrame = glfwGetTime();
+        float currentFrame = bench.enabled() ? bench.sceneTime() : (float) glfwGetTime();
         deltaTime = currentFrame - lastFrame + 0.2f;
         lastFrame = currentFrame;
 
         // input
         // -----
-        processInput(window);
+        if (bench.enabled())
+            bench.applyCamera(camera);
+        else
+            processInput(window);
 
+        // files saved since the last frame, shaders are rebuilt right here and models read on the workers
+        {
+            Profiler::Scope scope(profiler, "hot reload");
+            reloadChanged();
+        }
+
+        // upload models and textures the workers finished reading since the last frame
+        {
+            Profiler::Scope scope(profiler, "model uploads");
+            modelLoader.processUploads();
+        }
+        if (!modelsReported && modelLoader.pendingCount() == 0) {
+            reportModels();
+            modelsReported = true;
+        }
+        {
+            Profiler::Scope scope(profiler, "texture uploads");
+            TextureLoader::instance().processUploads();
+        }
 
         // render
         // ------
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // don't forget to enable shader before setting uniforms
-        sceneLight.use();
-        sceneLight.setVec3("viewPos", camera.Position);
-        sceneLight.setFloat("material.shininess", 16.0f);
-        sceneLight.setInt("blinn", blinn);
-        sceneLight.setInt("flashLight", flashLight);
-
-        // directional light
-        sceneLight.setVec3("dirLight.direction", glm::vec3(100.0f, -250.0f, -50.0f));
-        sceneLight.setVec3("dirLight.ambient", glm::vec3(0.1f, 0.1f, 0.1f));
-        sceneLight.setVec3("dirLight.diffuse", glm::vec3(0.5f, 0.5f, 0.5f));
-        sceneLight.setVec3("dirLight.specular", glm::vec3(1.0f, 1.0f, 1.0f));
-        
-        // point light
-        sceneLight.setVec3("pointLight.position", glm::vec3(0.0f, 0.0f, 10.0f));
-        sceneLight.setVec3("pointLight.ambient", glm::vec3(0.5, 0.5, 0.5));
-        sceneLight.setVec3("pointLight.diffuse", glm::vec3(0.6, 0.6, 0.6));
-        sceneLight.setVec3("pointLight.specular", glm::vec3(1.0, 1.0, 1.0));
-        sceneLight.setFloat("pointLight.constant", 1.0f);
-        sceneLight.setFloat("pointLight.linear", 0.09f);
-        sceneLight.setFloat("pointLight.quadratic", 0.032f);
-        
-        // spot light
-        sceneLight.setVec3("spotLight.position", camera.Position);
-        sceneLight.setVec3("spotLight.direction", camera.Front);
-        sceneLight.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-        sceneLight.setVec3("spotLight.diffuse", 0.7f, 0.7f, 0.7f);
-        sceneLight.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-        sceneLight.setFloat("spotLight.constant", 1.0f);
-        sceneLight.setFloat("spotLight.linear", 0.05);
-        sceneLight.setFloat("spotLight.quadratic", 0.012);
-        sceneLight.setFloat("spotLight.cutOff", glm::cos(glm::radians(10.5f)));
-        sceneLight.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(13.0f)));
-        
         // view/projection transformations
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
                                                 (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 1300.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        sceneLight.setMat4("projection", projection);
-        sceneLight.setMat4("view", view);
-
         glm::mat4 model = glm::mat4(1.0f);
-        sceneLight.setMat4("model", model);
+        // everything outside of it is skipped before any GL call
+        Frustum frustum(projection * view);
+        // models far away are drawn with fewer triangles
+        LodView lodView(camera.Position, projection);
+
+        // update the fleets
+        float time = currentFrame;
+        {
+            Profiler::Scope scope(profiler, "fleet update");
+            bombers.update(time);
+            fighters.update(time);
+            destroyers.update(time);
+            xWings.update(time);
+        }
+
+        // per-frame blocks of both scene programs, bound once for the whole frame
+        uniformRing.beginFrame();
+        writeSceneFrame(uniformRing, lights, projection, view);
+
+        // point lights of the frame, each fragment only shades the ones binned into its cluster
+        {
+            Profiler::Scope scope(profiler, "light clusters");
+            lightClusters.clear();
+            for (const InstanceTransforms *fleet : {&bombers, &fighters, &destroyers, &xWings})
+                for (const glm::mat4 &matrix : fleet->matrices)
+                    lightClusters.add(glm::vec3(matrix[3]), 8.0f, glm::vec3(2.0f, 0.9f, 0.5f));
+            for (const LaserBolt &bolt : laserBolts) {
+                float progress = bolt.phase + bolt.speed * time;
+                progress -= std::floor(progress);
+                lightClusters.add(glm::mix(bolt.from, bolt.to, progress), 5.0f, bolt.color);
+            }
+            lightClusters.update(uniformRing, view, projection, framebufferWidth, framebufferHeight);
+        }
 
-        // render imperial bombers
-        for (unsigned int i = 0 ; i < 11 ; i++) {
+        // cull the models and queue their draws, the fleets with one instanced draw per mesh and detail level
+        {
+            Profiler::Scope scope(profiler, "submit");
+            Shader &sceneShader = sceneLight.get(sceneLightFeatures());
+            Shader &sceneShaderInstanced = sceneLightInstanced.get(sceneLightFeatures());
+            bomber->DrawInstanced(renderQueue, sceneShaderInstanced, bombers.matrices, frustum, lodView);
+            starDestroyer->DrawInstanced(renderQueue, sceneShaderInstanced, destroyers.matrices, frustum, lodView);
+            xWingStarFighter->DrawInstanced(renderQueue, sceneShaderInstanced, xWings.matrices, frustum, lodView);
+            tieFighter->DrawInstanced(renderQueue, sceneShaderInstanced, fighters.matrices, frustum, lodView);
+
+            // millenium falcon
             model = glm::mat4(1.0f);
-            model = glm::translate(model,
-                                   bomberPositions[i]);
+            model = glm::translate(model, glm::vec3(0.0f, cos(time)+(-20.0f), sin(time)+140.0f));
+            model = glm::rotate(model, (float)sin(time), glm::vec3(0.0f, 0.0f, 0.5f));
             model = glm::rotate(model, glm::radians(25.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            model = glm::rotate(model, (float) glfwGetTime(), glm::vec3(0.0f, 0.0f, 1.0f));
-            model = glm::scale(model, glm::vec3(0.85f));
-            sceneLight.setMat4("model", model);
-            bomber.Draw(sceneLight);
-        }
+            model = glm::scale(model, glm::vec3(0.025f));
+            milleniumFalcon->Draw(renderQueue, sceneShader, -1, frustum, lodView, model, milleniumFalconLod);
 
-        // render millenium falcon
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, cos(glfwGetTime())+(-20.0f), sin(glfwGetTime())+140.0f));
-        model = glm::rotate(model, (float)sin(glfwGetTime()), glm::vec3(0.0f, 0.0f, 0.5f));
-        model = glm::rotate(model, glm::radians(25.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.025f));
-        sceneLight.setMat4("model", model);
-        milleniumFalcon.Draw(sceneLight);
-
-        glDisable(GL_CULL_FACE);
-        // render imperial fighter
-        for (unsigned int i = 0 ; i < 5 ; i++) {
+            // death star
             model = glm::mat4(1.0f);
-            model = glm::translate(model, fighterPositions[i]);
-            model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::rotate(model, glm::radians(-25.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-            model = glm::scale(model, glm::vec3(0.05f));
-            sceneLight.setMat4("model", model);
-            tieFighter.Draw(sceneLight);
+            model = glm::translate(model, glm::vec3(0.0f, 0.0f, -1300.0f));
+            model = glm::rotate(model, time/50, glm::vec3(0.0f, 1.0f, 0.0f));
+            model = glm::scale(model, glm::vec3(1.4f));
+            deathStar->Draw(renderQueue, sceneShader, -1, frustum, lodView, model, deathStarLod);
         }
-        glEnable(GL_CULL_FACE);
-
-        // render death star
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, -1300.0f));
-        model = glm::rotate(model, (float)glfwGetTime()/50, glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(1.4f));
-        sceneLight.setMat4("model", model);
-        deathStar.Draw(sceneLight);
-
-        // render star destroyer
-        for (unsigned int i = 0 ; i < 3 ; i++) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, destroyerPositions[i]);
-            model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            if (i == 1) {
-                model = glm::rotate(model, glm::radians(-25.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            }
-            if (i == 2) {
-                model = glm::rotate(model, glm::radians(35.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        // sorted by pass, cull state, program, textures and distance, the model matrices go through the Draw block
+        // with the depth pre-pass each pixel is shaded once, the overdraw view adds up how often it is shaded
+        {
+            Profiler::Scope scope(profiler, "render queue");
+            renderQueue.setDepthPrePass(depthPrePass ? &depthOnly.get(0) : nullptr,
+                                        depthPrePass ? &depthOnly.get(DEPTH_ONLY_INSTANCED) : nullptr);
+            if (overdrawView) {
+                glState.enable(GL_BLEND);
+                glState.blendFunc(GL_ONE, GL_ONE);
             }
-            model = glm::scale(model, glm::vec3(0.6f));
-            sceneLight.setMat4("model", model);
-            starDestroyer.Draw(sceneLight);
+            renderQueue.execute(uniformRing);
+            if (overdrawView)
+                glState.disable(GL_BLEND);
         }
 
-        // render x wing star fighter
-        // x wing star fighter objekti su kompleksniji i kada se ukljuce zahtevaju vise vremena pokretanje tj
-        // iskace prozor (You may choose to wait a short while to continue or force the application to quit)
-        for (unsigned int i = 0 ; i < 3 ; i++) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, xWingPositions[i]);
-            model = glm::rotate(model, glm::radians(15.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            model = glm::scale(model, glm::vec3(0.35f));
-            sceneLight.setMat4("model", model);
-            xWingStarFighter.Draw(sceneLight);
+        // the overdraw view shows the ships alone
+        if (!overdrawView) {
+            // star wars cube
+            profiler.begin("cube");
+            glState.disable(GL_CULL_FACE);
+            glm::mat4 cube = glm::mat4(1.0f);
+            swCube.use();
+            swCube.setMat4(cubeProjection, projection);
+            swCube.setMat4(cubeView, view);
+            swCube.setMat4(cubeModel, cube);
+            glState.bindVertexArray(swcubeVAO);
+            glState.bindTexture(0, GL_TEXTURE_2D, dartVader);
+            cube = glm::mat4(1.0f);
+//        cube = glm::translate(cube, glm::vec3(0.0f + cubeMoveLR, 0.0f + cubeMoveUD, -15.0f));
+            cube = glm::translate(cube, camera.Position + glm::vec3(0.0f));
+            cube = glm::rotate(cube, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+            cube = glm::rotate(cube, glm::radians(cubeRotate), glm::vec3(0.0f, 0.0f, 1.0f));
+            cube = glm::scale(cube, glm::vec3(2.0f));
+            swCube.setMat4(cubeModel, cube);
+
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            RenderStats::frame().draw(12);
+            glState.enable(GL_CULL_FACE);
+            profiler.end();
+
+            // skybox setup
+            profiler.begin("skybox");
+            glState.depthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+            skyboxShader.use();
+            view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
+            skyboxShader.setMat4(skyboxView, view);
+            skyboxShader.setMat4(skyboxProjection, projection);
+
+            // render skybox
+            glState.bindVertexArray(skyboxVAO);
+            glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            RenderStats::frame().draw(12);
+            glState.depthFunc(GL_LESS);
+            profiler.end();
         }
 
-        // star wars cube
-        glDisable(GL_CULL_FACE);
-        glm::mat4 cube = glm::mat4(1.0f);
-        swCube.use();
-        swCube.setMat4("projection", projection);
-        swCube.setMat4("view", view);
-        swCube.setMat4("model", cube);
-        glBindVertexArray(swcubeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, dartVader);
-        cube = glm::mat4(1.0f);
-//        cube = glm::translate(cube, glm::vec3(0.0f + cubeMoveLR, 0.0f + cubeMoveUD, -15.0f));
-        cube = glm::translate(cube, camera.Position + glm::vec3(0.0f));
-        cube = glm::rotate(cube, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        cube = glm::rotate(cube, glm::radians(cubeRotate), glm::vec3(0.0f, 0.0f, 1.0f));
-        cube = glm::scale(cube, glm::vec3(2.0f));
-        swCube.setMat4("model", cube);
-
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glEnable(GL_CULL_FACE);
-
-        // skybox setup
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-
-        // render skybox
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
+        if (showProfiler) {
+            Profiler::Scope scope(profiler, "overlay");
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+            profiler.drawOverlay();
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        profiler.endFrame();
+        if (writeTrace) {
+            profiler.writeChromeTrace(traceOutput.empty() ? "profile_trace.json" : traceOutput);
+            writeTrace = false;
+        }
+
+        bench.endFrame(profiler);
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -468,10 +770,28 @@ int main() {
         glfwPollEvents();
     }
 
+    if (bench.enabled()) {
+        bench.writeReport(benchmarkOutput);
+        bench.end();
+    }
+    if (!traceOutput.empty())
+        profiler.writeChromeTrace(traceOutput);
+    if (!bench.enabled()) {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
+
+    std::cout << "Textures use " << TextureCache::instance().stats().bytes / 1024 << " KiB of GPU memory" << std::endl;
+
     glDeleteVertexArrays(1, &swcubeVAO);
     glDeleteVertexArrays(1, &skyboxVAO);
     glDeleteBuffers(1, &swcubeVBO);
     glDeleteBuffers(1, &skyboxVBO);
+    // the destructors of these locals only run after glfwTerminate, without a context
+    uniformRing.release();
+    lightClusters.release();
+    renderQueue.release();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -479,6 +799,79 @@ int main() {
     return 0;
 }
 
+// material and uniform block bindings of the scene_light shaders, set once in every permutation since they
+// never change
+void setSceneLightConstants(Shader &shader) {
+    shader.use();
+    shader.setFloat("material.shininess", 16.0f);
+    // the array samplers must not share unit 0 with the 2D ones even in draws that don't use them
+    shader.setInt("material.texture_diffuse_array", Mesh::ARRAY_TEXTURE_UNIT);
+    shader.setInt("material.texture_specular_array", Mesh::ARRAY_TEXTURE_UNIT + 1);
+
+    shader.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    shader.bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+    shader.bindUniformBlock("Draw", RenderQueue::DRAW_BLOCK_BINDING);
+    shader.bindUniformBlock("Clusters", LightClusters::BLOCK_BINDING);
+    shader.setInt("clusterLights", LightClusters::LIGHTS_TEXTURE_UNIT);
+    shader.setInt("clusterGrid", LightClusters::GRID_TEXTURE_UNIT);
+    shader.setInt("clusterIndices", LightClusters::INDICES_TEXTURE_UNIT);
+}
+
+// uniform blocks of the depth_only programs
+void setDepthOnlyConstants(Shader &shader) {
+    shader.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    shader.bindUniformBlock("Draw", RenderQueue::DRAW_BLOCK_BINDING);
+}
+
+// features of the scene_light program the B, F and O keys turned on
+unsigned int sceneLightFeatures() {
+    if (overdrawView)
+        return FEATURE_OVERDRAW;
+    return (blinn ? FEATURE_BLINN : 0) | (flashLight ? FEATURE_FLASH_LIGHT : 0);
+}
+
+// lights of the scene, only the spot light changes per frame
+LightsBlock sceneLights() {
+    LightsBlock lights = {};
+
+    // directional light
+    lights.dirLight.direction = glm::vec3(100.0f, -250.0f, -50.0f);
+    lights.dirLight.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+    lights.dirLight.diffuse = glm::vec3(0.5f, 0.5f, 0.5f);
+    lights.dirLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+
+    // point light
+    lights.pointLight.position = glm::vec3(0.0f, 0.0f, 10.0f);
+    lights.pointLight.ambient = glm::vec3(0.5, 0.5, 0.5);
+    lights.pointLight.diffuse = glm::vec3(0.6, 0.6, 0.6);
+    lights.pointLight.specular = glm::vec3(1.0, 1.0, 1.0);
+    lights.pointLight.constant = 1.0f;
+    lights.pointLight.linear = 0.09f;
+    lights.pointLight.quadratic = 0.032f;
+
+    // spot light
+    lights.spotLight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+    lights.spotLight.diffuse = glm::vec3(0.7f, 0.7f, 0.7f);
+    lights.spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.spotLight.constant = 1.0f;
+    lights.spotLight.linear = 0.05f;
+    lights.spotLight.quadratic = 0.012f;
+    lights.spotLight.cutOff = glm::cos(glm::radians(10.5f));
+    lights.spotLight.outerCutOff = glm::cos(glm::radians(13.0f));
+    return lights;
+}
+
+// per-frame blocks of the scene_light shaders, written to the ring and bound for the rest of the frame
+void writeSceneFrame(UniformRing &ring, LightsBlock &lights, const glm::mat4 &projection, const glm::mat4 &view) {
+    CameraBlock cameraBlock = {projection, view, camera.Position, 0.0f};
+    ring.bind(CAMERA_BLOCK_BINDING, ring.write(&cameraBlock, sizeof(cameraBlock)), sizeof(cameraBlock));
+
+    // spot light follows the camera
+    lights.spotLight.position = camera.Position;
+    lights.spotLight.direction = camera.Front;
+    ring.bind(LIGHTS_BLOCK_BINDING, ring.write(&lights, sizeof(lights)), sizeof(lights));
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow *window) {
@@ -528,6 +921,50 @@ void processInput(GLFWwindow *window) {
     {
         flashLightKeyPressed = false;
     }
+
+    // depth pre-pass key
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !depthPrePassKeyPressed)
+    {
+        depthPrePass = !depthPrePass;
+        depthPrePassKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)
+    {
+        depthPrePassKeyPressed = false;
+    }
+
+    // overdraw view key
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && !overdrawKeyPressed)
+    {
+        overdrawView = !overdrawView;
+        overdrawKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
+    {
+        overdrawKeyPressed = false;
+    }
+
+    // profiler overlay key
+    if (glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS && !profilerKeyPressed)
+    {
+        showProfiler = !showProfiler;
+        profilerKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_F1) == GLFW_RELEASE)
+    {
+        profilerKeyPressed = false;
+    }
+
+    // Chrome trace key
+    if (glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS && !traceKeyPressed)
+    {
+        writeTrace = true;
+        traceKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_F2) == GLFW_RELEASE)
+    {
+        traceKeyPressed = false;
+    }
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -536,6 +973,8 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -562,69 +1001,13 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     camera.ProcessMouseScroll(yoffset);
 }
 
+// faces are decoded in parallel on the texture loader's worker threads and uploaded in processUploads()
 unsigned int loadCubemap(vector<std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    return TextureLoader::instance().loadCubemap(faces);
 }
 
 unsigned int loadTexture(char const * path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format = GL_RED;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, (GLint)format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
\ No newline at end of file
+    return TextureCache::instance().acquire(path);
+}
@@ -0,0 +1,193 @@
+// Builds the asset package the renderer maps with --package (see include/learnopengl/asset_package.h).
+//
+//   asset_packer [--no-compress] <project root> <output package>
+//
+// Packs the shaders, the images and .dds textures under resources/textures and resources/objects, and the
+// preprocessed meshes of resources/cache/models. Images without an up to date .dds next to them are block
+// compressed into the package as one (see tools/texture_compressor.cpp), unless --no-compress is given; the
+// images themselves stay in the package for cubemaps and texture arrays, which decode them. Model sources and
+// everything else (.obj, .mtl, .max, .fbx, Thumbs.db...) are left out, so the mesh cache has to be filled by
+// running the renderer once before packing.
+#include <stb_image.h>
+
+#include <learnopengl/asset_package.h>
+#include <learnopengl/dds.h>
+#include <learnopengl/texture_compress.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+static std::string extensionOf(const std::string &path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return "";
+    std::string extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
+}
+
+static bool isImage(const std::string &extension)
+{
+    return extension == "jpg" || extension == "jpeg" || extension == "png" || extension == "tga" || extension == "bmp";
+}
+
+static bool isPacked(const std::string &extension)
+{
+    return isImage(extension) || extension == "dds" || extension == "mesh" || extension == "vs" || extension == "fs"
+           || extension == "gs" || extension == "glsl";
+}
+
+static std::string ddsPathFor(const std::string &path)
+{
+    return path.substr(0, path.find_last_of('.')) + ".dds";
+}
+
+// files below directory, as paths relative to root
+static void collectFiles(const std::string &root, const std::string &directory, std::vector<std::string> &files, unsigned int &skipped)
+{
+    DIR *handle = opendir((root + '/' + directory).c_str());
+    if (!handle)
+        return;
+    while (dirent *entry = readdir(handle))
+    {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        std::string child = directory + '/' + name;
+        struct stat info;
+        if (stat((root + '/' + child).c_str(), &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode))
+            collectFiles(root, child, files, skipped);
+        else if (isPacked(extensionOf(child)))
+            files.push_back(child);
+        else
+            skipped++;
+    }
+    closedir(handle);
+}
+
+static bool readFile(const std::string &path, std::vector<unsigned char> &bytes)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    bytes.clear();
+    unsigned char chunk[1 << 16];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        bytes.insert(bytes.end(), chunk, chunk + read);
+    return fclose(file) == 0;
+}
+
+static bool upToDate(const std::string &source, const std::string &target)
+{
+    struct stat sourceInfo, targetInfo;
+    return stat(source.c_str(), &sourceInfo) == 0 && stat(target.c_str(), &targetInfo) == 0
+           && targetInfo.st_mtime >= sourceInfo.st_mtime;
+}
+
+int main(int argc, char **argv)
+{
+    bool compress = true;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--no-compress")
+            compress = false;
+        else
+            paths.push_back(argument);
+    }
+    if (paths.size() != 2)
+    {
+        std::cout << "usage: asset_packer [--no-compress] <project root> <output package>" << std::endl;
+        return 1;
+    }
+    const std::string &root = paths[0];
+    const std::string &output = paths[1];
+
+    std::vector<std::string> files;
+    unsigned int skipped = 0;
+    const char *directories[] = {"resources/shaders", "resources/textures", "resources/objects", "resources/cache/models"};
+    for (const char *directory : directories)
+        collectFiles(root, directory, files, skipped);
+    std::sort(files.begin(), files.end());
+    std::set<std::string> present(files.begin(), files.end());
+    // a .dds older than its image is replaced by a fresh one in the package
+    std::set<std::string> stale;
+    for (const std::string &file : files)
+    {
+        std::string dds = ddsPathFor(file);
+        if (compress && isImage(extensionOf(file)) && present.count(dds) && !upToDate(root + '/' + file, root + '/' + dds))
+            stale.insert(dds);
+    }
+
+    AssetPackage::Writer writer;
+    if (!writer.begin(output))
+    {
+        std::cout << "cannot write " << output << std::endl;
+        return 1;
+    }
+    int failures = 0;
+    unsigned int packed = 0, meshes = 0, compressed = 0;
+    std::vector<unsigned char> bytes;
+    for (const std::string &file : files)
+    {
+        if (stale.count(file))
+            continue;
+        std::string path = root + '/' + file;
+        if (!readFile(path, bytes) || !writer.add(file, bytes.data(), bytes.size()))
+        {
+            std::cout << "failed to pack " << file << std::endl;
+            failures++;
+            continue;
+        }
+        packed++;
+        std::string extension = extensionOf(file);
+        if (extension == "mesh")
+            meshes++;
+        std::string dds = ddsPathFor(file);
+        if (!compress || !isImage(extension) || (present.count(dds) && !stale.count(dds)))
+            continue;
+        int width, height, channels;
+        unsigned char *pixels = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &channels, 0);
+        if (!pixels)
+        {
+            std::cout << "failed to decode " << file << std::endl;
+            failures++;
+            continue;
+        }
+        GLenum format = TextureCompressor::chooseFormat(pixels, width, height, channels);
+        std::vector<std::vector<unsigned char>> mips = TextureCompressor::compressMipChain(pixels, width, height, channels, format);
+        stbi_image_free(pixels);
+        std::vector<unsigned char> encoded;
+        if (!DDSImage::encode(format, (unsigned int)width, (unsigned int)height, mips, encoded) || !writer.add(dds, encoded.data(), encoded.size()))
+        {
+            std::cout << "failed to pack " << dds << std::endl;
+            failures++;
+            continue;
+        }
+        compressed++;
+    }
+    if (!writer.finish())
+    {
+        std::cout << "failed to write " << output << std::endl;
+        return 1;
+    }
+
+    std::cout << output << ": " << packed + compressed << " files (" << compressed << " textures compressed, " << meshes
+              << " cached models), " << writer.size() / (1024 * 1024) << " MB, " << skipped << " other files left out" << std::endl;
+    if (meshes == 0)
+        std::cout << "resources/cache/models is empty, run the renderer once so the packed models need no import" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
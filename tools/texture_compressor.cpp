@@ -0,0 +1,152 @@
+// Offline converter from JPG/PNG to block compressed DDS textures with a full mip chain.
+//
+//   texture_compressor [--force] <image or directory>...
+//
+// Every image is written next to its source with the extension replaced by .dds (diffuse.jpg -> diffuse.dds),
+// which is the file the TextureLoader prefers at runtime. Directories are searched recursively and images whose
+// .dds is newer than the source are skipped unless --force is given.
+#include <stb_image.h>
+
+#include <learnopengl/dds.h>
+#include <learnopengl/texture_compress.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static bool hasImageExtension(const std::string &path)
+{
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+    std::string extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == "jpg" || extension == "jpeg" || extension == "png" || extension == "tga" || extension == "bmp";
+}
+
+static std::string ddsPathFor(const std::string &path)
+{
+    return path.substr(0, path.find_last_of('.')) + ".dds";
+}
+
+static void collectImages(const std::string &path, std::vector<std::string> &images)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        std::cout << "skipping " << path << ": not found" << std::endl;
+        return;
+    }
+    if (!S_ISDIR(info.st_mode))
+    {
+        images.push_back(path);
+        return;
+    }
+    DIR *directory = opendir(path.c_str());
+    if (!directory)
+        return;
+    while (dirent *entry = readdir(directory))
+    {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        std::string child = path + '/' + name;
+        if (stat(child.c_str(), &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode))
+            collectImages(child, images);
+        else if (hasImageExtension(child))
+            images.push_back(child);
+    }
+    closedir(directory);
+}
+
+static bool upToDate(const std::string &source, const std::string &target)
+{
+    struct stat sourceInfo, targetInfo;
+    return stat(source.c_str(), &sourceInfo) == 0 && stat(target.c_str(), &targetInfo) == 0
+           && targetInfo.st_mtime >= sourceInfo.st_mtime;
+}
+
+static const char* formatName(GLenum format)
+{
+    switch (format)
+    {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return "BC1";
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+        case GL_COMPRESSED_RED_RGTC1: return "BC4";
+        case GL_COMPRESSED_RG_RGTC2: return "BC5";
+        default: return "?";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool force = false;
+    std::vector<std::string> images;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--force")
+            force = true;
+        else
+            collectImages(argument, images);
+    }
+    if (images.empty())
+    {
+        std::cout << "usage: texture_compressor [--force] <image or directory>..." << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+    size_t sourceBytes = 0, compressedBytes = 0;
+    for (const std::string &image : images)
+    {
+        std::string output = ddsPathFor(image);
+        if (!force && upToDate(image, output))
+        {
+            std::cout << "up to date " << output << std::endl;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        int width, height, channels;
+        unsigned char *pixels = stbi_load(image.c_str(), &width, &height, &channels, 0);
+        if (!pixels)
+        {
+            std::cout << "failed to decode " << image << std::endl;
+            failures++;
+            continue;
+        }
+        GLenum format = TextureCompressor::chooseFormat(pixels, width, height, channels);
+        std::vector<std::vector<unsigned char>> mips = TextureCompressor::compressMipChain(pixels, width, height, channels, format);
+        stbi_image_free(pixels);
+
+        if (!DDSImage::write(output, format, (unsigned int)width, (unsigned int)height, mips))
+        {
+            std::cout << "failed to write " << output << std::endl;
+            failures++;
+            continue;
+        }
+
+        // uncompressed size as the runtime used to upload it, including glGenerateMipmap's chain
+        size_t uncompressed = (size_t)width * height * channels * 4 / 3;
+        size_t compressed = 0;
+        for (const std::vector<unsigned char> &mip : mips)
+            compressed += mip.size();
+        sourceBytes += uncompressed;
+        compressedBytes += compressed;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << output << ": " << width << "x" << height << " " << formatName(format) << ", " << mips.size()
+                  << " mips, " << uncompressed / 1024 << " KB -> " << compressed / 1024 << " KB (" << elapsed.count() << " ms)" << std::endl;
+    }
+
+    if (compressedBytes > 0)
+        std::cout << "total VRAM " << sourceBytes / (1024 * 1024) << " MB -> " << compressedBytes / (1024 * 1024) << " MB" << std::endl;
+    return failures == 0 ? 0 : 1;
+}